@@ -0,0 +1,154 @@
+#include "access_log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    constexpr char kMagic[8] = {'D', 'Z', 'A', 'C', 'C', 'E', 'S', 'S'};
+    constexpr uint8_t kSlideRecord = 'S';
+    constexpr uint8_t kAccessRecord = 'A';
+    constexpr uint8_t kDeadlineRecord = 'D'; // an access record followed by the deadline
+    constexpr std::size_t kAccessRecordSize = 1 + 8 + 2 + 1 + 1 + 4 + 4 + 4;
+    constexpr std::size_t kDeadlineRecordSize = kAccessRecordSize + 4;
+
+    void _put(std::vector<uint8_t>& buf, uint64_t v, int size)
+    {
+        for (auto i = 0; i < size; i++)
+            buf.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    uint64_t _get(uint8_t const*& p, int size)
+    {
+        uint64_t v = 0;
+        for (auto i = 0; i < size; i++)
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        p += size;
+        return v;
+    }
+
+    bool _same(AccessLogSlide const& a, AccessLogSlide const& b)
+    {
+        return a.path == b.path && a.tile_size == b.tile_size && a.overlap == b.overlap &&
+               a.limit_bounds == b.limit_bounds;
+    }
+} // namespace
+
+AccessLogWriter::AccessLogWriter(std::string const& path, std::size_t buffer_bytes)
+    : m_file(path, std::ios::binary | std::ios::trunc), m_start(std::chrono::steady_clock::now()),
+      m_buffer_bytes(buffer_bytes)
+{
+    m_file.write(kMagic, sizeof(kMagic));
+    m_buffer.reserve(buffer_bytes + kDeadlineRecordSize);
+}
+
+AccessLogWriter::~AccessLogWriter()
+{
+    flush();
+}
+
+uint16_t AccessLogWriter::add_slide(AccessLogSlide const& slide)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < m_slides.size(); i++)
+        if (_same(m_slides[i], slide)) return static_cast<uint16_t>(i);
+    auto const id = static_cast<uint16_t>(m_slides.size());
+    m_slides.push_back(slide);
+    m_buffer.push_back(kSlideRecord);
+    _put(m_buffer, id, 2);
+    _put(m_buffer, static_cast<uint32_t>(slide.tile_size), 4);
+    _put(m_buffer, static_cast<uint32_t>(slide.overlap), 4);
+    m_buffer.push_back(slide.limit_bounds ? 1 : 0);
+    _put(m_buffer, slide.path.size(), 2);
+    m_buffer.insert(m_buffer.end(), slide.path.begin(), slide.path.end());
+    return id;
+}
+
+void AccessLogWriter::record(uint16_t slide, TileIndex const& index, std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::duration latency, TileOutcome outcome,
+                             std::optional<std::chrono::steady_clock::duration> deadline)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    auto const timestamp = std::max<int64_t>(0, duration_cast<microseconds>(start - m_start).count());
+    auto const latency_us = std::clamp<int64_t>(duration_cast<microseconds>(latency).count(), 0, UINT32_MAX);
+    auto const deadline_us =
+        deadline ? std::clamp<int64_t>(duration_cast<microseconds>(*deadline).count(), 0, UINT32_MAX) : 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(deadline ? kDeadlineRecord : kAccessRecord);
+    _put(m_buffer, static_cast<uint64_t>(timestamp), 8);
+    _put(m_buffer, slide, 2);
+    m_buffer.push_back(static_cast<uint8_t>(index.level));
+    m_buffer.push_back(static_cast<uint8_t>(outcome));
+    _put(m_buffer, static_cast<uint32_t>(index.col), 4);
+    _put(m_buffer, static_cast<uint32_t>(index.row), 4);
+    _put(m_buffer, static_cast<uint32_t>(latency_us), 4);
+    if (deadline) _put(m_buffer, static_cast<uint32_t>(deadline_us), 4);
+    if (m_buffer.size() >= m_buffer_bytes) _flush();
+}
+
+bool AccessLogWriter::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return _flush();
+}
+
+bool AccessLogWriter::_flush()
+{
+    m_file.write(reinterpret_cast<char const*>(m_buffer.data()), m_buffer.size());
+    m_file.flush();
+    m_buffer.clear();
+    return static_cast<bool>(m_file);
+}
+
+std::optional<AccessLog> AccessLog::read(std::string const& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) return std::nullopt;
+
+    AccessLog log;
+    log.records.reserve(data.size() / kAccessRecordSize);
+    auto const* p = data.data() + sizeof(kMagic);
+    auto const* const end = data.data() + data.size();
+    while (p < end)
+    {
+        if (*p == kAccessRecord || *p == kDeadlineRecord)
+        {
+            auto const with_deadline = *p == kDeadlineRecord;
+            if (static_cast<std::size_t>(end - p) < (with_deadline ? kDeadlineRecordSize : kAccessRecordSize)) break;
+            p++;
+            AccessRecord r;
+            r.timestamp_us = _get(p, 8);
+            r.slide = static_cast<uint16_t>(_get(p, 2));
+            r.index.level = static_cast<int>(_get(p, 1));
+            r.outcome = static_cast<TileOutcome>(_get(p, 1));
+            r.index.col = static_cast<int64_t>(_get(p, 4));
+            r.index.row = static_cast<int64_t>(_get(p, 4));
+            r.latency_us = static_cast<uint32_t>(_get(p, 4));
+            if (with_deadline) r.deadline_us = static_cast<uint32_t>(_get(p, 4));
+            if (r.slide < log.slides.size()) log.records.push_back(r);
+        }
+        else if (*p == kSlideRecord)
+        {
+            if (end - p < 14) break;
+            p++;
+            auto const id = _get(p, 2);
+            AccessLogSlide slide;
+            slide.tile_size = static_cast<int>(_get(p, 4));
+            slide.overlap = static_cast<int>(_get(p, 4));
+            slide.limit_bounds = _get(p, 1) != 0;
+            auto const size = _get(p, 2);
+            if (static_cast<uint64_t>(end - p) < size) break;
+            slide.path.assign(reinterpret_cast<char const*>(p), size);
+            p += size;
+            if (id != log.slides.size()) return std::nullopt;
+            log.slides.push_back(std::move(slide));
+        }
+        else
+            return std::nullopt;
+    }
+    return log;
+}
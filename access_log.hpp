@@ -0,0 +1,83 @@
+#pragma once
+
+#include "tile_order.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// how a tile request was served
+enum class TileOutcome : uint8_t
+{
+    Rendered,   // cache miss, rendered by this request
+    HotHit,     // raw tile cache
+    ColdHit,    // compressed tile cache tier
+    Coalesced,  // waited on an identical render already running
+    Provisional // deadline passed, got a stand-in cut from an ancestor tile
+};
+
+// a slide and the generator settings its tiles were requested with
+struct AccessLogSlide
+{
+    std::string path;
+    int tile_size = 254;
+    int overlap = 1;
+    bool limit_bounds = false;
+};
+
+struct AccessRecord
+{
+    uint64_t timestamp_us = 0; // request start, from the start of the log
+    uint16_t slide = 0;        // index into AccessLog::slides
+    TileIndex index;
+    uint32_t latency_us = 0;
+    TileOutcome outcome = TileOutcome::Rendered;
+    // for a request with a deadline (TileService::get_tile with a time point), the time it had from its start
+    std::optional<uint32_t> deadline_us;
+};
+
+// compact binary log of tile requests: a header, then records of 25 bytes each (29 for requests with a deadline) with
+// slide definitions interleaved
+// records are buffered and written in blocks, thread safe
+class AccessLogWriter
+{
+public:
+    explicit AccessLogWriter(std::string const& path, std::size_t buffer_bytes = std::size_t{64} << 10);
+    ~AccessLogWriter();
+
+    AccessLogWriter(AccessLogWriter const&) = delete;
+    AccessLogWriter& operator=(AccessLogWriter const&) = delete;
+
+    bool ok() const { return static_cast<bool>(m_file); }
+    // id of `slide` in this log, registered on first use
+    uint16_t add_slide(AccessLogSlide const& slide);
+    // `deadline` is the time a request with a deadline had from `start`
+    void record(uint16_t slide, TileIndex const& index, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::duration latency, TileOutcome outcome,
+                std::optional<std::chrono::steady_clock::duration> deadline = std::nullopt);
+    bool flush();
+
+private:
+    bool _flush();
+
+private:
+    std::mutex m_mutex;
+    std::ofstream m_file;
+    std::chrono::steady_clock::time_point m_start;
+    std::size_t m_buffer_bytes = 0;
+    std::vector<uint8_t> m_buffer;
+    std::vector<AccessLogSlide> m_slides;
+};
+
+struct AccessLog
+{
+    std::vector<AccessLogSlide> slides;
+    std::vector<AccessRecord> records; // in the order they were logged, which is completion order
+
+    // std::nullopt if the file is not an access log, a record cut short at the end is dropped
+    static std::optional<AccessLog> read(std::string const& path);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// lock-free bounded multi-producer multi-consumer queue
+// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// the capacity is rounded up to a power of two
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t capacity)
+    {
+        m_capacity = 2;
+        while (m_capacity < capacity)
+            m_capacity *= 2;
+        m_mask = m_capacity - 1;
+        m_cells = std::make_unique<Cell[]>(m_capacity);
+        for (std::size_t i = 0; i < m_capacity; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(BoundedQueue const&) = delete;
+    BoundedQueue& operator=(BoundedQueue const&) = delete;
+
+    // false if the queue is full, `value` is left untouched then
+    bool try_push(T& value)
+    {
+        auto pos = m_enqueue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            auto seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_enqueue.load(std::memory_order_relaxed);
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // false if the queue is empty
+    bool try_pop(T& value)
+    {
+        auto pos = m_dequeue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            auto seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_dequeue.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t capacity() const { return m_capacity; }
+    // approximate while other threads push or pop
+    std::size_t size() const
+    {
+        auto e = m_enqueue.load(std::memory_order_relaxed), d = m_dequeue.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    std::size_t m_capacity = 0;
+    std::size_t m_mask = 0;
+    alignas(64) std::atomic<std::size_t> m_enqueue{0};
+    alignas(64) std::atomic<std::size_t> m_dequeue{0};
+};
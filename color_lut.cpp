@@ -0,0 +1,312 @@
+#include "color_lut.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <optional>
+
+#ifdef DEEPZOOM_HAVE_LCMS2
+#include <lcms2.h>
+#endif
+
+namespace
+{
+    constexpr int G = ColorLut::kGridSize;
+    constexpr int kLaneBits = 21;
+    constexpr uint64_t kLaneMask = (uint64_t{1} << kLaneBits) - 1;
+
+    uint32_t _u32(uint8_t const* p)
+    {
+        return (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | p[3];
+    }
+
+    double _s15fixed16(uint8_t const* p)
+    {
+        return static_cast<int32_t>(_u32(p)) / 65536.;
+    }
+
+    // tone reproduction curve of a matrix/TRC profile, device value -> linear
+    struct Curve
+    {
+        std::vector<double> table; // curv with more than one entry, evenly spaced
+        int function = -1;         // para function type, or 0 with params[0] = gamma for a single entry curv
+        double params[7] = {1., 0., 0., 0., 0., 0., 0.};
+
+        double operator()(double x) const
+        {
+            if (!table.empty())
+            {
+                auto pos = std::clamp(x, 0., 1.) * (table.size() - 1);
+                auto i = std::min(static_cast<std::size_t>(pos), table.size() - 2);
+                return table[i] + (pos - i) * (table[i + 1] - table[i]);
+            }
+            auto const &g = params[0], &a = params[1], &b = params[2], &c = params[3], &d = params[4],
+                       &e = params[5], &f = params[6];
+            switch (function)
+            {
+            case 0:
+                return std::pow(x, g);
+            case 1:
+                return x >= -b / a ? std::pow(a * x + b, g) : 0.;
+            case 2:
+                return x >= -b / a ? std::pow(a * x + b, g) + c : c;
+            case 3:
+                return x >= d ? std::pow(a * x + b, g) : c * x;
+            case 4:
+                return x >= d ? std::pow(a * x + b, g) + e : c * x + f;
+            default:
+                return x; // identity
+            }
+        }
+    };
+
+    // https://www.color.org/specification/ICC.1-2022-05.pdf
+    class IccProfile
+    {
+    public:
+        IccProfile(uint8_t const* data, std::size_t size) : m_data(data), m_size(size) {}
+
+        bool valid() const
+        {
+            return m_size >= 132 && _u32(m_data) <= m_size && std::memcmp(m_data + 36, "acsp", 4) == 0 &&
+                   std::memcmp(m_data + 16, "RGB ", 4) == 0;
+        }
+
+        // <offset, size> of a tag, nullopt if missing or out of bounds
+        std::optional<std::pair<std::size_t, std::size_t>> tag(char const* signature) const
+        {
+            auto const count = _u32(m_data + 128);
+            for (uint32_t i = 0; i < count && 132 + 12 * (i + 1) <= m_size; i++)
+            {
+                auto const* entry = m_data + 132 + 12 * i;
+                if (std::memcmp(entry, signature, 4) != 0) continue;
+                std::size_t offset = _u32(entry + 4), size = _u32(entry + 8);
+                if (offset + size > m_size || size < 12) return std::nullopt;
+                return std::make_pair(offset, size);
+            }
+            return std::nullopt;
+        }
+
+        std::optional<std::array<double, 3>> xyz(char const* signature) const
+        {
+            auto t = tag(signature);
+            if (!t || t->second < 20 || std::memcmp(m_data + t->first, "XYZ ", 4) != 0) return std::nullopt;
+            auto const* p = m_data + t->first + 8;
+            return std::array<double, 3>{_s15fixed16(p), _s15fixed16(p + 4), _s15fixed16(p + 8)};
+        }
+
+        std::optional<Curve> curve(char const* signature) const
+        {
+            auto t = tag(signature);
+            if (!t) return std::nullopt;
+            auto const* p = m_data + t->first;
+            Curve curve;
+            if (std::memcmp(p, "curv", 4) == 0)
+            {
+                auto const n = _u32(p + 8);
+                if (12 + 2 * std::size_t{n} > t->second) return std::nullopt;
+                if (n == 1)
+                {
+                    curve.function = 0;
+                    curve.params[0] = ((p[12] << 8) | p[13]) / 256.;
+                }
+                for (uint32_t i = 0; n > 1 && i < n; i++)
+                    curve.table.push_back(((p[12 + 2 * i] << 8) | p[13 + 2 * i]) / 65535.);
+                return curve;
+            }
+            if (std::memcmp(p, "para", 4) == 0)
+            {
+                static constexpr int kParams[] = {1, 3, 4, 5, 7};
+                curve.function = (p[8] << 8) | p[9];
+                if (curve.function > 4 || 12 + 4 * std::size_t(kParams[curve.function]) > t->second)
+                    return std::nullopt;
+                for (auto i = 0; i < kParams[curve.function]; i++)
+                    curve.params[i] = _s15fixed16(p + 12 + 4 * i);
+                return curve;
+            }
+            return std::nullopt;
+        }
+
+    private:
+        uint8_t const* m_data;
+        std::size_t m_size;
+    };
+
+    double _srgb_encode(double linear)
+    {
+        linear = std::clamp(linear, 0., 1.);
+        return linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow(linear, 1. / 2.4) - 0.055;
+    }
+
+    // matrix/TRC profiles only: device -> TRC -> XYZ (D50 PCS) -> linear sRGB -> sRGB
+    std::shared_ptr<ColorLut const> _matrix_trc_lut(IccProfile const& icc)
+    {
+        auto r = icc.xyz("rXYZ"), g = icc.xyz("gXYZ"), b = icc.xyz("bXYZ");
+        auto rc = icc.curve("rTRC"), gc = icc.curve("gTRC"), bc = icc.curve("bTRC");
+        if (!r || !g || !b || !rc || !gc || !bc) return nullptr;
+
+        // XYZ (D50) to linear sRGB, Bradford adapted
+        static constexpr double kXyzToSrgb[3][3] = {{3.1338561, -1.6168667, -0.4906146},
+                                                    {-0.9787684, 1.9161415, 0.0334540},
+                                                    {0.0719453, -0.2289914, 1.4052427}};
+        // the primaries' XYZ are the columns of the device to XYZ matrix
+        std::array<double, 3> const primaries[3] = {*r, *g, *b};
+        double m[3][3];
+        for (auto i = 0; i < 3; i++)
+            for (auto j = 0; j < 3; j++)
+                m[i][j] = kXyzToSrgb[i][0] * primaries[j][0] + kXyzToSrgb[i][1] * primaries[j][1] +
+                          kXyzToSrgb[i][2] * primaries[j][2];
+
+        return std::make_shared<ColorLut const>([&](double const rgb[3], double srgb[3]) {
+            double const linear[3] = {(*rc)(rgb[0]), (*gc)(rgb[1]), (*bc)(rgb[2])};
+            for (auto i = 0; i < 3; i++)
+                srgb[i] = _srgb_encode(m[i][0] * linear[0] + m[i][1] * linear[1] + m[i][2] * linear[2]);
+        });
+    }
+
+#ifdef DEEPZOOM_HAVE_LCMS2
+    std::shared_ptr<ColorLut const> _lcms_lut(uint8_t const* profile, std::size_t size)
+    {
+        auto in = cmsOpenProfileFromMem(profile, static_cast<cmsUInt32Number>(size));
+        if (!in) return nullptr;
+        auto out = cmsCreate_sRGBProfile();
+        auto transform = cmsCreateTransform(in, TYPE_RGB_16, out, TYPE_RGB_16, INTENT_PERCEPTUAL, 0);
+        cmsCloseProfile(in);
+        cmsCloseProfile(out);
+        if (!transform) return nullptr;
+
+        // the whole grid in one call, then the LUT is filled from the results
+        std::vector<uint16_t> nodes, results(G * G * G * 3);
+        nodes.reserve(results.size());
+        for (auto r = 0; r < G; r++)
+            for (auto g = 0; g < G; g++)
+                for (auto b = 0; b < G; b++)
+                    for (auto v : {r, g, b})
+                        nodes.push_back(static_cast<uint16_t>(v * 65535 / (G - 1)));
+        cmsDoTransform(transform, nodes.data(), results.data(), G * G * G);
+        cmsDeleteTransform(transform);
+
+        return std::make_shared<ColorLut const>([&](double const rgb[3], double srgb[3]) {
+            auto node = [](double v) { return static_cast<std::size_t>(std::lround(v * (G - 1))); };
+            auto const i = ((node(rgb[0]) * G + node(rgb[1])) * G + node(rgb[2])) * 3;
+            for (auto c = 0; c < 3; c++)
+                srgb[c] = results[i + c] / 65535.;
+        });
+    }
+#endif
+} // namespace
+
+ColorLut::ColorLut(std::function<void(double const rgb[3], double srgb[3])> const& transform)
+{
+    m_table.resize(G * G * G);
+    for (auto r = 0; r < G; r++)
+        for (auto g = 0; g < G; g++)
+            for (auto b = 0; b < G; b++)
+            {
+                double const rgb[3] = {r / (G - 1.), g / (G - 1.), b / (G - 1.)};
+                double srgb[3];
+                transform(rgb, srgb);
+                uint64_t node = 0;
+                for (auto c = 0; c < 3; c++)
+                    node |= static_cast<uint64_t>(std::lround(std::clamp(srgb[c], 0., 1.) * 255. * 16.))
+                            << (kLaneBits * c);
+                m_table[(r * G + g) * G + b] = node;
+            }
+
+    // 8 bit input -> grid cell and 8 bit weight, the last value lands on the far end of the last cell
+    for (auto v = 0; v < 256; v++)
+    {
+        auto const x = v * (G - 1);
+        auto i = x / 255;
+        auto w = ((x % 255) * 256 + 127) / 255;
+        if (i == G - 1) i = G - 2, w = 256;
+        m_index[v] = static_cast<uint8_t>(i);
+        m_weight[v] = static_cast<uint16_t>(w);
+    }
+}
+
+std::shared_ptr<ColorLut const> ColorLut::from_icc(uint8_t const* profile, std::size_t size)
+{
+    if (!profile) return nullptr;
+    IccProfile icc(profile, size);
+    if (!icc.valid()) return nullptr;
+#ifdef DEEPZOOM_HAVE_LCMS2
+    if (auto lut = _lcms_lut(profile, size); lut) return lut;
+#endif
+    return _matrix_trc_lut(icc);
+}
+
+void ColorLut::apply(uint32_t const* argb, uint8_t* bgra, int64_t n) const
+{
+    auto const* table = m_table.data();
+    // strides of the r, g and b grid axes
+    constexpr int sr = G * G, sg = G, sb = 1;
+    // tiles have long runs of one color (background), those reuse the previous result
+    uint32_t last_in = 0;
+    uint32_t last_out = 0;
+    for (int64_t i = 0; i < n; i++)
+    {
+        auto const p = argb[i];
+        auto* out = bgra + 4 * i;
+        if (p == last_in && i > 0)
+        {
+            std::memcpy(out, &last_out, 4);
+            continue;
+        }
+        last_in = p;
+        auto const a = p >> 24;
+        if (a == 0)
+        {
+            last_out = 0;
+            std::memcpy(out, &last_out, 4);
+            continue;
+        }
+        uint32_t r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+        if (a != 255)
+        {
+            // the LUT maps straight colors
+            r = std::min(255u, (r * 255 + a / 2) / a);
+            g = std::min(255u, (g * 255 + a / 2) / a);
+            b = std::min(255u, (b * 255 + a / 2) / a);
+        }
+
+        // tetrahedral interpolation: the cell is split into six tetrahedra along its main diagonal, the ordering of
+        // the weights picks one and the result blends its four corners
+        int const fr = m_weight[r], fg = m_weight[g], fb = m_weight[b];
+        auto const* c000 = table + m_index[r] * sr + m_index[g] * sg + m_index[b] * sb;
+        auto const* c111 = c000 + sr + sg + sb;
+        uint64_t const *c1, *c2;
+        uint64_t w0, w1, w2, w3;
+        if (fr >= fg)
+        {
+            if (fg >= fb) // r >= g >= b
+                c1 = c000 + sr, c2 = c000 + sr + sg, w0 = 256 - fr, w1 = fr - fg, w2 = fg - fb, w3 = fb;
+            else if (fr >= fb) // r >= b > g
+                c1 = c000 + sr, c2 = c000 + sr + sb, w0 = 256 - fr, w1 = fr - fb, w2 = fb - fg, w3 = fg;
+            else // b > r >= g
+                c1 = c000 + sb, c2 = c000 + sr + sb, w0 = 256 - fb, w1 = fb - fr, w2 = fr - fg, w3 = fg;
+        }
+        else
+        {
+            if (fr >= fb) // g > r >= b
+                c1 = c000 + sg, c2 = c000 + sr + sg, w0 = 256 - fg, w1 = fg - fr, w2 = fr - fb, w3 = fb;
+            else if (fg >= fb) // g >= b > r
+                c1 = c000 + sg, c2 = c000 + sg + sb, w0 = 256 - fg, w1 = fg - fb, w2 = fb - fr, w3 = fr;
+            else // b > g > r
+                c1 = c000 + sb, c2 = c000 + sg + sb, w0 = 256 - fb, w1 = fb - fg, w2 = fg - fr, w3 = fr;
+        }
+        // all three channels at once, 12 bit nodes * 8 bit weights, rounded back to 8 bits
+        auto const v = w0 * *c000 + w1 * *c1 + w2 * *c2 + w3 * *c111;
+        uint32_t rgb[3];
+        for (auto c = 0; c < 3; c++)
+            rgb[c] = static_cast<uint32_t>((((v >> (kLaneBits * c)) & kLaneMask) + 2048) >> 12);
+        if (a != 255)
+            for (auto& x : rgb)
+                x = (x * a + 127) / 255;
+        uint8_t const pixel[4] = {static_cast<uint8_t>(rgb[2]), static_cast<uint8_t>(rgb[1]),
+                                  static_cast<uint8_t>(rgb[0]), static_cast<uint8_t>(a)};
+        std::memcpy(&last_out, pixel, 4);
+        std::memcpy(out, pixel, 4);
+    }
+}
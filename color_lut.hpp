@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// device RGB to sRGB as a 3D lookup table, sampled once per slide so the per-pixel cost is one tetrahedral
+// interpolation instead of a full color transform
+class ColorLut
+{
+public:
+    static constexpr int kGridSize = 33;
+
+    // samples `transform` (device rgb in [0, 1] -> sRGB in [0, 1]) on the grid
+    explicit ColorLut(std::function<void(double const rgb[3], double srgb[3])> const& transform);
+
+    // LUT from an ICC profile to sRGB, nullptr if the profile is not supported
+    // with lcms2 (DEEPZOOM_HAVE_LCMS2) every RGB profile is, without it only matrix/TRC profiles
+    static std::shared_ptr<ColorLut const> from_icc(uint8_t const* profile, std::size_t size);
+
+    // premultiplied ARGB as read from openslide to b, g, r, a bytes with the LUT applied, `n` pixels
+    void apply(uint32_t const* argb, uint8_t* bgra, int64_t n) const;
+
+private:
+    // one uint64 per grid node holding r, g and b as 12 bit fixed point (value * 16) in 21 bit lanes, so a weighted
+    // sum of nodes with weights adding up to 256 interpolates all three channels at once without lane overflow
+    // node (r, g, b) at (r * G + g) * G + b
+    std::vector<uint64_t> m_table;
+    uint8_t m_index[256];   // grid cell of an 8 bit input, same for every channel
+    uint16_t m_weight[256]; // position inside the cell, 0..256
+};
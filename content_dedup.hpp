@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+struct DedupStats
+{
+    int64_t tiles = 0;
+    int64_t unique_tiles = 0;
+    uint64_t bytes = 0;        // all tiles
+    uint64_t unique_bytes = 0; // stored
+
+    // bytes of all tiles per byte stored, 1 without duplicates
+    double ratio() const { return unique_bytes > 0 ? static_cast<double>(bytes) / unique_bytes : 1.; }
+};
+
+// where the first copy of each encoded payload was stored, so byte-identical tiles (background, blank) can point to
+// it instead of being stored again
+// payloads match on size and 64 bit content hash, a false match is as unlikely as any other hash collision at
+// pyramid scale
+// thread safe
+template <typename Location>
+class ContentDedup
+{
+public:
+    // the location of an identical payload stored earlier, std::nullopt if there is none
+    std::optional<Location> find(uint64_t hash, uint64_t size) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_locations.find(hash);
+        if (it == m_locations.end() || it->second.first != size) return std::nullopt;
+        return it->second.second;
+    }
+
+    // records a stored payload
+    void insert(uint64_t hash, uint64_t size, Location location)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_locations.emplace(hash, std::make_pair(size, std::move(location)));
+        m_stats.tiles++;
+        m_stats.unique_tiles++;
+        m_stats.bytes += size;
+        m_stats.unique_bytes += size;
+    }
+
+    // counts a tile that points to the payload find returned
+    void add_duplicate(uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.tiles++;
+        m_stats.bytes += size;
+    }
+
+    DedupStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, std::pair<uint64_t, Location>> m_locations; // hash -> <size, location>
+    DedupStats m_stats;
+};
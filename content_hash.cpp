@@ -0,0 +1,81 @@
+#include "content_hash.hpp"
+
+namespace
+{
+    constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t _rotl(uint64_t v, int r)
+    {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    // little endian loads, whatever the host
+    uint64_t _read64(uint8_t const* p)
+    {
+        uint64_t v = 0;
+        for (auto i = 0; i < 8; i++)
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        return v;
+    }
+
+    uint32_t _read32(uint8_t const* p)
+    {
+        return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+               static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    uint64_t _round(uint64_t acc, uint64_t input)
+    {
+        return _rotl(acc + input * kPrime2, 31) * kPrime1;
+    }
+
+    uint64_t _merge(uint64_t acc, uint64_t v)
+    {
+        return (acc ^ _round(0, v)) * kPrime1 + kPrime4;
+    }
+} // namespace
+
+uint64_t content_hash(uint8_t const* data, std::size_t size, uint64_t seed)
+{
+    auto const* p = data;
+    auto const* const end = data + size;
+    uint64_t h;
+    if (size >= 32)
+    {
+        // four independent lanes over 32 byte stripes
+        uint64_t v1 = seed + kPrime1 + kPrime2, v2 = seed + kPrime2, v3 = seed, v4 = seed - kPrime1;
+        for (; end - p >= 32; p += 32)
+        {
+            v1 = _round(v1, _read64(p));
+            v2 = _round(v2, _read64(p + 8));
+            v3 = _round(v3, _read64(p + 16));
+            v4 = _round(v4, _read64(p + 24));
+        }
+        h = _rotl(v1, 1) + _rotl(v2, 7) + _rotl(v3, 12) + _rotl(v4, 18);
+        h = _merge(_merge(_merge(_merge(h, v1), v2), v3), v4);
+    }
+    else
+        h = seed + kPrime5;
+    h += static_cast<uint64_t>(size);
+
+    for (; end - p >= 8; p += 8)
+        h = _rotl(h ^ _round(0, _read64(p)), 27) * kPrime1 + kPrime4;
+    if (end - p >= 4)
+    {
+        h = _rotl(h ^ (_read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = _rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// fast non-cryptographic 64 bit hash of a byte string (XXH64), for telling tiles apart, not for security
+uint64_t content_hash(uint8_t const* data, std::size_t size, uint64_t seed = 0);
+
+inline uint64_t content_hash(std::vector<uint8_t> const& data, uint64_t seed = 0)
+{
+    return content_hash(data.data(), data.size(), seed);
+}
@@ -1,37 +1,96 @@
 #include "deepzoom.hpp"
+#include "image_ops.hpp"
 
+#include <algorithm>
 #include <memory>
 #include <numeric>
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+    // OpenSlide emits samples as uint32_t, i.e. b, g, r, a in memory on little-endian systems
+    // with a color LUT the pixels are color converted in the same pass
+    std::vector<uint8_t> _argb_to_bytes(uint32_t const* buf, int64_t n, ColorLut const* lut)
+    {
+        std::vector<uint8_t> data;
+        if (lut)
+        {
+            data.resize(n * 4);
+            lut->apply(buf, data.data(), n);
+            return data;
+        }
+        data.reserve(n * 4);
+        for (int64_t i = 0; i < n; i++)
+        {
+            auto p = buf[i];
+            data.push_back(p);       // b
+            data.push_back(p >> 8);  // g
+            data.push_back(p >> 16); // r
+            data.push_back(p >> 24); // a
+        }
+        return data;
+    }
+
+    std::pair<int64_t, int64_t> _native_tile_size(SlideSource const& source, int slide_level)
+    {
+        auto prefix = "openslide.level[" + std::to_string(slide_level) + "].";
+        auto const* w = source.get_property_value((prefix + "tile-width").c_str());
+        auto const* h = source.get_property_value((prefix + "tile-height").c_str());
+        if (!w || !h) return {0, 0};
+        return {std::strtoll(w, nullptr, 10), std::strtoll(h, nullptr, 10)};
+    }
+
+    // geometry files are text, strings are length prefixed since property values may contain anything
+    constexpr char const* kGeometryMagic = "deepzoom-geometry";
+    constexpr int kGeometryVersion = 1;
+
+    void _write_string(std::ostream& out, std::string const& s)
+    {
+        out << s.size() << ' ' << s << '\n';
+    }
+
+    bool _read_string(std::istream& in, std::string& s)
+    {
+        std::size_t n = 0;
+        if (!(in >> n) || in.get() != ' ') return false;
+        s.resize(n);
+        return static_cast<bool>(in.read(s.data(), n));
+    }
+} // namespace
 
 DeepZoomGenerator::DeepZoomGenerator(openslide_t* slide, int tile_size, int overlap, bool limit_bounds)
-    : m_slide(slide), m_tile_size(tile_size), m_overlap(overlap), m_limit_bounds(limit_bounds)
+    : DeepZoomGenerator(std::make_shared<OpenSlideSource>(slide), tile_size, overlap, limit_bounds)
 {
-    if (auto mpp_x = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_MPP_X); mpp_x)
-        if (auto mpp_y = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_MPP_Y); mpp_y)
+}
+
+DeepZoomGenerator::DeepZoomGenerator(std::shared_ptr<SlideSource> source, int tile_size, int overlap,
+                                     bool limit_bounds)
+    : m_source(std::move(source)), m_tile_size(tile_size), m_overlap(overlap), m_limit_bounds(limit_bounds)
+{
+    if (auto mpp_x = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_MPP_X); mpp_x)
+        if (auto mpp_y = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_MPP_Y); mpp_y)
             m_mpp = (std::strtof(mpp_x, nullptr) + std::strtof(mpp_y, nullptr)) / 2.f;
 
-    m_levels = openslide_get_level_count(m_slide);
+    m_levels = m_source->get_level_count();
     m_l_dimensions.reserve(m_levels);
-    int64_t w = -1, h = -1;
     for (auto l = 0; l < m_levels; l++)
-    {
-        openslide_get_level_dimensions(m_slide, l, &w, &h);
-        m_l_dimensions.push_back({w, h});
-    }
+        m_l_dimensions.push_back(m_source->get_level_dimensions(l));
 
     if (m_limit_bounds)
     {
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_X); p)
+        if (auto const* p = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_X); p)
             m_l0_offset.first = std::strtol(p, nullptr, 10);
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_Y); p)
+        if (auto const* p = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_Y); p)
             m_l0_offset.second = std::strtol(p, nullptr, 10);
 
         auto l0_lim = m_l_dimensions[0];
         std::pair<double, double> size_scale{1., 1.};
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_WIDTH); p)
+        if (auto const* p = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_WIDTH); p)
             size_scale.first = std::strtol(p, nullptr, 10) / static_cast<double>(l0_lim.first);
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_HEIGHT); p)
+        if (auto const* p = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_HEIGHT); p)
             size_scale.second = std::strtol(p, nullptr, 10) / static_cast<double>(l0_lim.second);
 
         for (auto& d : m_l_dimensions)
@@ -41,38 +100,16 @@ DeepZoomGenerator::DeepZoomGenerator(openslide_t* slide, int tile_size, int over
         }
     }
 
-    m_dzl_dimensions.push_back(m_l_dimensions[0]);
-    while (m_dzl_dimensions.back().first > 1 || m_dzl_dimensions.back().second > 1)
-        m_dzl_dimensions.push_back({std::max(int64_t{1}, (m_dzl_dimensions.back().first + 1) / 2),
-                                    std::max(int64_t{1}, (m_dzl_dimensions.back().second + 1) / 2)});
-    std::reverse(m_dzl_dimensions.begin(), m_dzl_dimensions.end());
-    m_dz_levels = m_dzl_dimensions.size();
-
-    m_t_dimensions.reserve(m_dz_levels);
-    for (const auto& d : m_dzl_dimensions)
-        m_t_dimensions.push_back({static_cast<int64_t>(std::ceil(static_cast<double>(d.first) / m_tile_size)),
-                                  static_cast<int64_t>(std::ceil(static_cast<double>(d.second) / m_tile_size))});
-
-    std::vector<double> level_0_dz_downsamples;
-    level_0_dz_downsamples.reserve(m_dz_levels);
-    m_preferred_slide_levels.reserve(m_dz_levels);
-    for (auto l = 0; l < m_dz_levels; l++)
-    {
-        auto d = std::pow(2, (m_dz_levels - l - 1));
-        level_0_dz_downsamples.push_back(d);
-        m_preferred_slide_levels.push_back(openslide_get_best_level_for_downsample(m_slide, d));
-    }
-
     m_level_downsamples.reserve(m_levels);
     for (auto l = 0; l < m_levels; l++)
-        m_level_downsamples.push_back(openslide_get_level_downsample(m_slide, l));
+        m_level_downsamples.push_back(m_source->get_level_downsample(l));
 
-    m_level_dz_downsamples.reserve(m_dz_levels);
-    for (auto l = 0; l < m_dz_levels; l++)
-        m_level_dz_downsamples.push_back(level_0_dz_downsamples[l] / m_level_downsamples[m_preferred_slide_levels[l]]);
+    _init_dz_levels();
 
-    if (auto bg_color = openslide_get_property_value(m_slide, OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); bg_color)
+    if (auto bg_color = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); bg_color)
         m_background_color = std::string("#") + bg_color;
+
+    set_coarse_level_cache(true);
 }
 
 int DeepZoomGenerator::level_count() const
@@ -92,34 +129,134 @@ std::vector<std::pair<int64_t, int64_t>> DeepZoomGenerator::level_dimensions() c
 
 int64_t DeepZoomGenerator::tile_count() const
 {
-    return std::reduce(m_t_dimensions.cbegin(), m_t_dimensions.cend(), int64_t{1},
-                       [](auto s, auto const& d) { return s + d.first * d.second; });
+    return std::accumulate(m_t_dimensions.cbegin(), m_t_dimensions.cend(), int64_t{0},
+                           [](auto s, auto const& d) { return s + d.first * d.second; });
 }
 
 std::tuple<int, int, std::vector<uint8_t>> DeepZoomGenerator::get_tile(int dz_level, int col, int row) const
 {
+    return convert_tile_region(read_tile_region(dz_level, col, row));
+}
+
+TileRegion DeepZoomGenerator::read_tile_region(int dz_level, int col, int row) const
+{
+    TileRegion region;
+    if (dz_level <= m_coarse_base_level && _load_coarse_levels())
+    {
+        auto [w, h, data] = _get_coarse_tile(dz_level, col, row);
+        region.z_width = region.read_width = w;
+        region.z_height = region.read_height = h;
+        region.data = std::move(data);
+        return region;
+    }
+
     auto [info, z_size] = _get_tile_info(dz_level, col, row);
     auto const& [l0_location, slide_level, l_size] = info;
-    auto const& [width, height] = l_size;
     auto const& [xx, yy] = l0_location;
+    std::tie(region.z_width, region.z_height) = z_size;
+    std::tie(region.read_width, region.read_height) = l_size;
 
     // https://openslide.org/docs/premultiplied-argb/
-    auto buf = std::make_unique<uint32_t[]>(width * height);
-    openslide_read_region(m_slide, buf.get(), xx, yy, slide_level, width, height);
-    std::vector<uint8_t> data;
-    data.reserve(width * height * 4);
-    uint32_t p = 0;
-    for (int64_t i = 0; i < width * height; i++)
+    region.argb.resize(region.read_width * region.read_height);
+    region.failed =
+        !m_source->read_region(region.argb.data(), xx, yy, slide_level, region.read_width, region.read_height);
+    return region;
+}
+
+std::tuple<int, int, std::vector<uint8_t>> DeepZoomGenerator::convert_tile_region(TileRegion region) const
+{
+    auto const width = region.read_width, height = region.read_height;
+    auto data = region.argb.empty() ? std::move(region.data)
+                                    : _argb_to_bytes(region.argb.data(), width * height, m_color_lut.get());
+    // the region was read at the slide level resolution, scale it to the deepzoom tile size
+    if (region.z_width != width || region.z_height != height)
+        return std::make_tuple(static_cast<int>(region.z_width), static_cast<int>(region.z_height),
+                               resize_bgra(data, width, height, region.z_width, region.z_height));
+    return std::make_tuple(static_cast<int>(width), static_cast<int>(height), std::move(data));
+}
+
+void DeepZoomGenerator::set_coarse_level_cache(bool enabled, bool lazy)
+{
+    m_coarse_base_level = -1;
+    m_coarse_lazy = lazy;
+    m_coarse = std::make_shared<CoarseLevels>();
+    if (!enabled || m_levels <= 0) return;
+
+    // the smallest slide level is read in one piece, skip slides where even that level is large
+    auto const& [w, h] = m_l_dimensions.back();
+    if (w * h > kMaxCoarseReadPixels) return;
+    for (auto l = m_dz_levels - 1; l >= 0; l--)
+        if (m_dzl_dimensions[l].first <= w && m_dzl_dimensions[l].second <= h)
+        {
+            m_coarse_base_level = l;
+            break;
+        }
+    if (!lazy) _load_coarse_levels();
+}
+
+bool DeepZoomGenerator::set_color_management(bool enabled)
+{
+    if (!enabled)
     {
-        p = buf[i];
-        // according to the docs: OpenSlide emits samples as uint32_t, so on little-endian systems the output will need to be byte-swapped relative to the input.
-        // i have to reverse the order to obtain the correct color
-        data.push_back(p);       // b
-        data.push_back(p >> 8);  // g
-        data.push_back(p >> 16); // r
-        data.push_back(p >> 24); // a
+        set_color_lut(nullptr);
+        return true;
     }
-    return std::make_tuple(width, height, std::move(data));
+    auto const profile = m_source->get_icc_profile();
+    auto lut = ColorLut::from_icc(profile.data(), profile.size());
+    if (!lut) return false;
+    set_color_lut(std::move(lut));
+    return true;
+}
+
+void DeepZoomGenerator::set_color_lut(std::shared_ptr<ColorLut const> lut)
+{
+    m_color_lut = std::move(lut);
+    // the coarse levels were converted with the previous setting
+    set_coarse_level_cache(m_coarse_base_level >= 0, m_coarse_lazy);
+}
+
+int DeepZoomGenerator::coarse_level_count() const
+{
+    return m_coarse->failed ? 0 : m_coarse_base_level + 1;
+}
+
+bool DeepZoomGenerator::_load_coarse_levels() const
+{
+    if (m_coarse->ready) return true;
+    std::lock_guard<std::mutex> lock(m_coarse->mutex);
+    if (m_coarse->ready) return true;
+    auto const slide_level = m_levels - 1;
+    auto const& [w, h] = m_l_dimensions[slide_level];
+    auto buf = std::make_unique<uint32_t[]>(w * h);
+    // not loaded, a later request tries again
+    m_coarse->failed = !m_source->read_region(buf.get(), m_l0_offset.first, m_l0_offset.second, slide_level, w, h);
+    if (m_coarse->failed) return false;
+    auto image = _argb_to_bytes(buf.get(), w * h, m_color_lut.get());
+    buf.reset();
+
+    // mip chain from the base level down to 1x1, each level is an area average of the previous one
+    auto& images = m_coarse->images;
+    images.resize(m_coarse_base_level + 1);
+    auto src_w = w, src_h = h;
+    auto const* src = &image;
+    for (auto l = m_coarse_base_level; l >= 0; l--)
+    {
+        auto const& [dw, dh] = m_dzl_dimensions[l];
+        images[l] = resize_bgra(*src, src_w, src_h, dw, dh);
+        src = &images[l], src_w = dw, src_h = dh;
+    }
+    m_coarse->ready = true;
+    return true;
+}
+
+std::tuple<int, int, std::vector<uint8_t>> DeepZoomGenerator::_get_coarse_tile(int dz_level, int col, int row) const
+{
+    auto const z_size = std::get<1>(_get_tile_info(dz_level, col, row));
+    auto const x = m_tile_size * col - (col != 0 ? m_overlap : 0);
+    auto const y = m_tile_size * row - (row != 0 ? m_overlap : 0);
+    return std::make_tuple(static_cast<int>(z_size.first), static_cast<int>(z_size.second),
+                           crop_bgra(m_coarse->images[dz_level], m_dzl_dimensions[dz_level].first, x, y,
+                                     z_size.first, z_size.second));
 }
 
 std::tuple<std::pair<int64_t, int64_t>, int, std::pair<int64_t, int64_t>> DeepZoomGenerator::get_tile_coordinates(
@@ -154,6 +291,237 @@ std::string DeepZoomGenerator::get_dzi(std::string const& format) const
 </Image>";
 }
 
+
+std::string DeepZoomGenerator::quickhash() const
+{
+    auto const* hash = m_source->get_property_value(OPENSLIDE_PROPERTY_NAME_QUICKHASH1);
+    return hash ? hash : "";
+}
+
+bool DeepZoomGenerator::save_geometry(std::string const& path) const
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) return false;
+    out << std::setprecision(17);
+    out << kGeometryMagic << ' ' << kGeometryVersion << '\n';
+    _write_string(out, quickhash());
+
+    // the source as LazySlideSource needs it
+    auto const metadata = slide_metadata(*m_source);
+    out << metadata.level_dimensions.size() << '\n';
+    for (size_t l = 0; l < metadata.level_dimensions.size(); l++)
+        out << metadata.level_dimensions[l].first << ' ' << metadata.level_dimensions[l].second << ' '
+            << metadata.level_downsamples[l] << '\n';
+    out << metadata.properties.size() << '\n';
+    for (auto const& [name, value] : metadata.properties)
+    {
+        _write_string(out, name);
+        _write_string(out, value);
+    }
+
+    // the generator tables
+    out << m_tile_size << ' ' << m_overlap << ' ' << m_limit_bounds << ' ' << m_l0_offset.first << ' '
+        << m_l0_offset.second << ' ' << m_mpp << ' ' << m_coarse_base_level << '\n';
+    _write_string(out, m_background_color);
+    out << m_levels << '\n';
+    for (auto l = 0; l < m_levels; l++)
+        out << m_l_dimensions[l].first << ' ' << m_l_dimensions[l].second << ' ' << m_level_downsamples[l] << '\n';
+    out << m_dz_levels << '\n';
+    for (auto l = 0; l < m_dz_levels; l++)
+    {
+        auto const& selection = m_level_selections[l];
+        out << m_dzl_dimensions[l].first << ' ' << m_dzl_dimensions[l].second << ' ' << m_t_dimensions[l].first << ' '
+            << m_t_dimensions[l].second << ' ' << m_preferred_slide_levels[l] << ' ' << m_level_dz_downsamples[l]
+            << ' ' << static_cast<int>(selection.policy) << ' ' << selection.max_upscale << ' '
+            << selection.max_pixels_per_tile << '\n';
+    }
+    out.close();
+    return static_cast<bool>(out);
+}
+
+std::optional<DeepZoomGenerator> DeepZoomGenerator::load_geometry(std::string const& path,
+                                                                  std::string const& slide_path)
+{
+    return _load_geometry(path, nullptr, &slide_path);
+}
+
+std::optional<DeepZoomGenerator> DeepZoomGenerator::load_geometry(std::string const& path,
+                                                                  std::shared_ptr<SlideSource> source)
+{
+    if (!source) return std::nullopt;
+    return _load_geometry(path, std::move(source), nullptr);
+}
+
+std::optional<DeepZoomGenerator> DeepZoomGenerator::_load_geometry(std::string const& path,
+                                                                   std::shared_ptr<SlideSource> source,
+                                                                   std::string const* slide_path)
+{
+    std::ifstream in(path);
+    std::string magic, hash;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != kGeometryMagic || version != kGeometryVersion) return std::nullopt;
+    if (in.get() != '\n' || !_read_string(in, hash)) return std::nullopt;
+
+    SlideMetadata metadata;
+    size_t count = 0;
+    if (!(in >> count)) return std::nullopt;
+    metadata.level_dimensions.resize(count);
+    metadata.level_downsamples.resize(count);
+    for (size_t l = 0; l < count; l++)
+        in >> metadata.level_dimensions[l].first >> metadata.level_dimensions[l].second >>
+            metadata.level_downsamples[l];
+    if (!(in >> count) || in.get() != '\n') return std::nullopt;
+    for (size_t i = 0; i < count; i++)
+    {
+        std::string name, value;
+        if (!_read_string(in, name) || in.get() != '\n' || !_read_string(in, value) || in.get() != '\n')
+            return std::nullopt;
+        metadata.properties.emplace(std::move(name), std::move(value));
+    }
+
+    if (source)
+    {
+        // the geometry is keyed by the slide's quickhash and its level 0 dimensions and level count, so slides
+        // without a quickhash do not all match each other
+        auto const* source_hash = source->get_property_value(OPENSLIDE_PROPERTY_NAME_QUICKHASH1);
+        if (hash != (source_hash ? source_hash : "")) return std::nullopt;
+        if (metadata.level_dimensions.empty() ||
+            source->get_level_count() != static_cast<int>(metadata.level_dimensions.size()) ||
+            source->get_level_dimensions(0) != metadata.level_dimensions[0])
+            return std::nullopt;
+    }
+    else
+        source = std::make_shared<LazySlideSource>(*slide_path, std::move(metadata));
+
+    DeepZoomGenerator g;
+    g.m_source = std::move(source);
+    in >> g.m_tile_size >> g.m_overlap >> g.m_limit_bounds >> g.m_l0_offset.first >> g.m_l0_offset.second >>
+        g.m_mpp >> g.m_coarse_base_level;
+    if (!in || in.get() != '\n' || !_read_string(in, g.m_background_color) || g.m_tile_size <= 0)
+        return std::nullopt;
+    if (!(in >> g.m_levels) || g.m_levels <= 0) return std::nullopt;
+    g.m_l_dimensions.resize(g.m_levels);
+    g.m_level_downsamples.resize(g.m_levels);
+    for (auto l = 0; l < g.m_levels; l++)
+        in >> g.m_l_dimensions[l].first >> g.m_l_dimensions[l].second >> g.m_level_downsamples[l];
+    if (!(in >> g.m_dz_levels) || g.m_dz_levels <= 0) return std::nullopt;
+    g.m_dzl_dimensions.resize(g.m_dz_levels);
+    g.m_t_dimensions.resize(g.m_dz_levels);
+    g.m_preferred_slide_levels.resize(g.m_dz_levels);
+    g.m_level_dz_downsamples.resize(g.m_dz_levels);
+    g.m_level_selections.resize(g.m_dz_levels);
+    for (auto l = 0; l < g.m_dz_levels; l++)
+    {
+        auto& selection = g.m_level_selections[l];
+        int policy = 0;
+        in >> g.m_dzl_dimensions[l].first >> g.m_dzl_dimensions[l].second >> g.m_t_dimensions[l].first >>
+            g.m_t_dimensions[l].second >> g.m_preferred_slide_levels[l] >> g.m_level_dz_downsamples[l] >> policy >>
+            selection.max_upscale >> selection.max_pixels_per_tile;
+        selection.policy = static_cast<LevelPolicy>(policy);
+        if (g.m_preferred_slide_levels[l] < 0 || g.m_preferred_slide_levels[l] >= g.m_levels) return std::nullopt;
+    }
+    if (!in || g.m_levels != g.m_source->get_level_count() || g.m_coarse_base_level >= g.m_dz_levels)
+        return std::nullopt;
+
+    // the coarse mip chain is rebuilt lazily on first use
+    g.m_coarse = std::make_shared<CoarseLevels>();
+    return g;
+}
+
+std::pair<int64_t, int64_t> DeepZoomGenerator::native_tile_size(int slide_level) const
+{
+    return _native_tile_size(*m_source, slide_level);
+}
+
+NativeDecodeStats DeepZoomGenerator::native_decodes_per_tile(int dz_level) const
+{
+    NativeDecodeStats stats;
+    auto const slide_level = m_preferred_slide_levels[dz_level];
+    auto const [tw, th] = native_tile_size(slide_level);
+    if (tw <= 0 || th <= 0) return stats;
+
+    // the touched columns only depend on the tile column and the touched rows only on the tile row
+    auto const downsample = m_level_downsamples[slide_level];
+    auto span = [&](int64_t l0, int64_t size, int64_t native) {
+        auto first = static_cast<int64_t>(std::floor(l0 / downsample));
+        return (first + std::max(int64_t{1}, size) - 1) / native - first / native + 1;
+    };
+    auto const& [cols, rows] = m_t_dimensions[dz_level];
+    int64_t col_sum = 0, col_max = 0, row_sum = 0, row_max = 0;
+    for (int64_t col = 0; col < cols; col++)
+    {
+        auto const [l0_location, level, l_size] = get_tile_coordinates(dz_level, static_cast<int>(col), 0);
+        auto n = span(l0_location.first, l_size.first, tw);
+        col_sum += n, col_max = std::max(col_max, n);
+    }
+    for (int64_t row = 0; row < rows; row++)
+    {
+        auto const [l0_location, level, l_size] = get_tile_coordinates(dz_level, 0, static_cast<int>(row));
+        auto n = span(l0_location.second, l_size.second, th);
+        row_sum += n, row_max = std::max(row_max, n);
+    }
+    stats.tiles = cols * rows;
+    stats.mean = (static_cast<double>(col_sum) / cols) * (static_cast<double>(row_sum) / rows);
+    stats.max = col_max * row_max;
+    return stats;
+}
+
+NativeTileAlignment DeepZoomGenerator::recommend_alignment(SlideSource const& source, bool limit_bounds)
+{
+    NativeTileAlignment a;
+    a.native_tile_size = _native_tile_size(source, 0);
+    auto const [tw, th] = a.native_tile_size;
+    if (tw <= 0 || th <= 0)
+    {
+        // no fixed internal tiles (e.g. strip based formats), keep the defaults
+        a.tile_size = 254;
+        a.overlap = 1;
+        return a;
+    }
+
+    // square dz tiles: the smallest common multiple of the native width and height, if it stays reasonable
+    auto l = std::lcm(tw, th);
+    a.tile_size = static_cast<int>(l <= 2048 ? l : std::max(tw, th));
+    a.overlap = 0;
+    a.aligned = a.tile_size % tw == 0 && a.tile_size % th == 0;
+    if (limit_bounds)
+    {
+        if (auto const* p = source.get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_X); p)
+            a.l0_offset.first = std::strtol(p, nullptr, 10);
+        if (auto const* p = source.get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_Y); p)
+            a.l0_offset.second = std::strtol(p, nullptr, 10);
+        a.l0_offset.first -= a.l0_offset.first % tw;
+        a.l0_offset.second -= a.l0_offset.second % th;
+    }
+    return a;
+}
+
+DeepZoomGenerator DeepZoomGenerator::aligned(std::shared_ptr<SlideSource> source, bool limit_bounds)
+{
+    auto a = recommend_alignment(*source, limit_bounds);
+    DeepZoomGenerator generator(source, a.tile_size, a.overlap, limit_bounds);
+    if (generator.m_l0_offset != a.l0_offset)
+    {
+        // grow the bounds by the distance the offset moved, without leaving the slide
+        auto const dx = generator.m_l0_offset.first - a.l0_offset.first;
+        auto const dy = generator.m_l0_offset.second - a.l0_offset.second;
+        generator.m_l0_offset = a.l0_offset;
+        for (auto l = 0; l < generator.m_levels; l++)
+        {
+            auto const ds = generator.m_level_downsamples[l];
+            auto const [full_w, full_h] = source->get_level_dimensions(l);
+            auto& d = generator.m_l_dimensions[l];
+            d.first = std::min(full_w - static_cast<int64_t>(a.l0_offset.first / ds),
+                               d.first + static_cast<int64_t>(std::ceil(dx / ds)));
+            d.second = std::min(full_h - static_cast<int64_t>(a.l0_offset.second / ds),
+                                d.second + static_cast<int64_t>(std::ceil(dy / ds)));
+        }
+        generator._init_dz_levels();
+        generator.set_coarse_level_cache(true);
+    }
+    return generator;
+}
+
 std::pair<std::tuple<std::pair<int64_t, int64_t>, // l0_location
                      int,                         // slide_level
                      std::pair<int64_t, int64_t>  // l_size
@@ -187,4 +555,80 @@ DeepZoomGenerator::_get_tile_info(int dz_level, int col, int row) const
         std::min(static_cast<int64_t>(std::ceil(l_dz_downsample * z_size.second)),
                  m_l_dimensions[slide_level].second - static_cast<int64_t>(std::ceil(l_location.second))));
     return std::make_pair(std::make_tuple(l0_location, slide_level, l_size), z_size);
-}
\ No newline at end of file
+}
+
+void DeepZoomGenerator::_init_dz_levels()
+{
+    m_dzl_dimensions.clear();
+    m_t_dimensions.clear();
+    m_preferred_slide_levels.clear();
+    m_level_dz_downsamples.clear();
+
+    m_dzl_dimensions.push_back(m_l_dimensions[0]);
+    while (m_dzl_dimensions.back().first > 1 || m_dzl_dimensions.back().second > 1)
+        m_dzl_dimensions.push_back({std::max(int64_t{1}, (m_dzl_dimensions.back().first + 1) / 2),
+                                    std::max(int64_t{1}, (m_dzl_dimensions.back().second + 1) / 2)});
+    std::reverse(m_dzl_dimensions.begin(), m_dzl_dimensions.end());
+    m_dz_levels = m_dzl_dimensions.size();
+
+    m_t_dimensions.reserve(m_dz_levels);
+    for (const auto& d : m_dzl_dimensions)
+        m_t_dimensions.push_back({static_cast<int64_t>(std::ceil(static_cast<double>(d.first) / m_tile_size)),
+                                  static_cast<int64_t>(std::ceil(static_cast<double>(d.second) / m_tile_size))});
+
+    std::vector<double> level_0_dz_downsamples;
+    level_0_dz_downsamples.reserve(m_dz_levels);
+    m_preferred_slide_levels.reserve(m_dz_levels);
+    for (auto l = 0; l < m_dz_levels; l++)
+        level_0_dz_downsamples.push_back(std::pow(2, (m_dz_levels - l - 1)));
+    m_level_selections.resize(m_dz_levels);
+    for (auto l = 0; l < m_dz_levels; l++)
+        m_preferred_slide_levels.push_back(_select_slide_level(l, level_0_dz_downsamples[l]));
+
+    m_level_dz_downsamples.reserve(m_dz_levels);
+    for (auto l = 0; l < m_dz_levels; l++)
+        m_level_dz_downsamples.push_back(level_0_dz_downsamples[l] / m_level_downsamples[m_preferred_slide_levels[l]]);
+}
+
+int DeepZoomGenerator::_select_slide_level(int dz_level, double l0_downsample) const
+{
+    auto const best = m_source->get_best_level_for_downsample(l0_downsample);
+    auto const& selection = m_level_selections[dz_level];
+    switch (selection.policy)
+    {
+    case LevelPolicy::Fast: {
+        // slide levels are ordered by increasing downsample
+        auto level = best;
+        while (level + 1 < m_levels && m_level_downsamples[level + 1] <= l0_downsample * selection.max_upscale)
+            level++;
+        return level;
+    }
+    case LevelPolicy::Budget: {
+        if (selection.max_pixels_per_tile <= 0) return best;
+        auto const side = static_cast<double>(m_tile_size + 2 * m_overlap);
+        auto level = best;
+        while (level + 1 < m_levels)
+        {
+            auto const scale = l0_downsample / m_level_downsamples[level];
+            if (side * scale * side * scale <= static_cast<double>(selection.max_pixels_per_tile)) break;
+            level++;
+        }
+        return level;
+    }
+    default:
+        return best;
+    }
+}
+
+void DeepZoomGenerator::set_level_policy(LevelSelection const& selection)
+{
+    std::fill(m_level_selections.begin(), m_level_selections.end(), selection);
+    _init_dz_levels();
+}
+
+void DeepZoomGenerator::set_level_policy(int dz_level, LevelSelection const& selection)
+{
+    if (dz_level < 0 || dz_level >= m_dz_levels) return;
+    m_level_selections[dz_level] = selection;
+    _init_dz_levels();
+}
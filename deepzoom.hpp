@@ -1,16 +1,67 @@
 #pragma once
 
-#include <openslide.h>
+#include "color_lut.hpp"
+#include "slide_source.hpp"
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 #include <string>
+#include <tuple>
 #include <utility>
 
+// native tile geometry of a slide and the deepzoom geometry lining up with it
+struct NativeTileAlignment
+{
+    std::pair<int64_t, int64_t> native_tile_size{0, 0}; // level 0 <width, height>, {0, 0} if the format has none
+    int tile_size = 0;                                   // recommended tile size, a multiple of the native tile size
+    int overlap = 0;                                     // any overlap makes tiles straddle native tile boundaries
+    std::pair<int64_t, int64_t> l0_offset{0, 0};         // recommended level 0 offset, bounds snapped to the native grid
+    bool aligned = false;                                // dz tiles never straddle native tiles at full resolution
+};
+
+// number of native tiles a slide read touches, per dz tile of one level
+struct NativeDecodeStats
+{
+    int64_t tiles = 0;
+    double mean = 0.;
+    int64_t max = 0;
+};
+
+// how the slide level read for a deepzoom level is chosen
+enum class LevelPolicy
+{
+    Quality, // openslide's best level for the downsample, never upscales
+    Fast,    // the coarsest level that needs at most `max_upscale` enlargement
+    Budget   // the finest level reading at most `max_pixels_per_tile` slide pixels per tile
+};
+
+struct LevelSelection
+{
+    LevelPolicy policy = LevelPolicy::Quality;
+    double max_upscale = 2.;         // Fast
+    int64_t max_pixels_per_tile = 0; // Budget, 0 means unlimited
+};
+
+// slide pixels read for one dz tile, not yet scaled to the tile size
+struct TileRegion
+{
+    int64_t z_width = 0, z_height = 0;       // tile size
+    int64_t read_width = 0, read_height = 0; // size of `argb`
+    std::vector<uint32_t> argb;              // premultiplied ARGB as read from the slide
+    std::vector<uint8_t> data;               // set instead of `argb` for tiles cut from the coarse level cache
+    bool failed = false;                     // the slide read failed, `argb` is not the slide's pixels
+};
+
 class DeepZoomGenerator
 {
 public:
     DeepZoomGenerator(openslide_t* slide, int tile_size = 254, int overlap = 1, bool limit_bounds = false);
+    DeepZoomGenerator(std::shared_ptr<SlideSource> source, int tile_size = 254, int overlap = 1,
+                      bool limit_bounds = false);
     ~DeepZoomGenerator() = default;
 
     DeepZoomGenerator(DeepZoomGenerator const&) = delete;
@@ -21,6 +72,11 @@ public:
 
     // deepzoom levels
     int level_count() const;
+    int tile_size() const { return static_cast<int>(m_tile_size); }
+    int overlap() const { return m_overlap; }
+    bool limit_bounds() const { return m_limit_bounds; }
+    // microns per level 0 pixel, the mean of openslide.mpp-x and openslide.mpp-y, 0 if the slide does not say
+    double mpp() const { return m_mpp; }
     // tile dimensions <col, row>
     std::vector<std::pair<int64_t, int64_t>> level_tiles() const;
     // deepzoom level dimensions <col, row>
@@ -28,6 +84,10 @@ public:
     int64_t tile_count() const;
     // <width, height, ARGB_Premultiplied_bytes>
     std::tuple<int, int, std::vector<uint8_t>> get_tile(int dz_level, int col, int row) const;
+    // get_tile in two halves, the slide read and the conversion to tile bytes, so pipelined exports can run them on
+    // separate threads
+    TileRegion read_tile_region(int dz_level, int col, int row) const;
+    std::tuple<int, int, std::vector<uint8_t>> convert_tile_region(TileRegion region) const;
     // <<x, y>, slide_level, <width, height>>
     std::tuple<std::pair<int64_t, int64_t>, int, std::pair<int64_t, int64_t>> get_tile_coordinates(int dz_level,
                                                                                                    int col,
@@ -37,7 +97,67 @@ public:
     // XML
     std::string get_dzi(std::string const& format) const;
 
+    // coarse levels: the dz levels up to the size of the smallest slide level are cut from an in-memory mip chain
+    // built from a single read of that slide level, enabled and lazy by default
+    void set_coarse_level_cache(bool enabled, bool lazy = true);
+    // number of dz levels (from level 0) served from memory, 0 while the slide read for them keeps failing: their
+    // tiles are then read from the slide like any other and every request retries the load
+    int coarse_level_count() const;
+
+    // slide level selection, applied per dz level, quality by default
+    // use separate generators on the same source for e.g. fast interactive tiles and quality exports
+    void set_level_policy(LevelSelection const& selection);
+    void set_level_policy(int dz_level, LevelSelection const& selection);
+    // slide level read for each dz level
+    std::vector<int> preferred_slide_levels() const { return m_preferred_slide_levels; }
+
+    // color management: tiles are converted from the slide's ICC profile to sRGB through a 3D LUT built once, in
+    // the same pass that unpacks the slide pixels; off by default
+    // returns false and leaves it off if the slide has no supported profile
+    bool set_color_management(bool enabled);
+    // reuse the LUT of another generator on the same slide, nullptr turns color management off
+    void set_color_lut(std::shared_ptr<ColorLut const> lut);
+    std::shared_ptr<ColorLut const> color_lut() const { return m_color_lut; }
+
+    // the slide metadata and every table the constructor computes, so a generator can be restored without opening
+    // the slide, returns false on I/O error
+    bool save_geometry(std::string const& path) const;
+    // generator saved by save_geometry that opens `slide_path` only on the first pixel read (see LazySlideSource),
+    // DZI descriptors, tile coordinates and dimensions never touch the slide
+    // std::nullopt if the file is missing or malformed
+    static std::optional<DeepZoomGenerator> load_geometry(std::string const& path, std::string const& slide_path);
+    // same on an already opened source, std::nullopt also if its quickhash, level count or level 0 dimensions differ
+    // from the saved ones
+    static std::optional<DeepZoomGenerator> load_geometry(std::string const& path,
+                                                          std::shared_ptr<SlideSource> source);
+    // openslide.quickhash-1 of the slide, empty if it has none
+    std::string quickhash() const;
+
+    SlideSource const& source() const { return *m_source; }
+    std::pair<int64_t, int64_t> l0_offset() const { return m_l0_offset; }
+
+    // native tile alignment
+    // <width, height> from openslide.level[n].tile-width/height, {0, 0} if unknown
+    std::pair<int64_t, int64_t> native_tile_size(int slide_level) const;
+    // native tiles decoded per dz tile of `dz_level` when read at its preferred slide level, zeros if unknown
+    NativeDecodeStats native_decodes_per_tile(int dz_level) const;
+    // tile size, overlap and offset for which dz tiles of the levels that map 1:1 onto a slide level cover whole
+    // native tiles only
+    static NativeTileAlignment recommend_alignment(SlideSource const& source, bool limit_bounds = false);
+    // generator using the recommended geometry, the bounds offset is snapped down to the native grid
+    static DeepZoomGenerator aligned(std::shared_ptr<SlideSource> source, bool limit_bounds = false);
+
 private:
+    // filled in by load_geometry
+    DeepZoomGenerator() = default;
+    static std::optional<DeepZoomGenerator> _load_geometry(std::string const& path, std::shared_ptr<SlideSource> source,
+                                                           std::string const* slide_path);
+    // deepzoom level tables from m_l_dimensions and m_level_downsamples
+    void _init_dz_levels();
+    int _select_slide_level(int dz_level, double l0_downsample) const;
+    bool _load_coarse_levels() const;
+    std::tuple<int, int, std::vector<uint8_t>> _get_coarse_tile(int dz_level, int col, int row) const;
+
     auto _get_tile_info(int dz_level, int col, int row) const
         -> std::pair<std::tuple<std::pair<int64_t, int64_t>, // l0_location
                                 int,                         // slide_level
@@ -47,13 +167,13 @@ private:
                      >;
 
 private:
-    openslide_t* m_slide = nullptr;
+    std::shared_ptr<SlideSource> m_source;
     int64_t m_tile_size =
         512; // the width and height of a single tile, for best viewer performance, tile_size + 2 * overlap should be a power of two
     int m_overlap = 1;                             // the number of extra pixels to add to each interior edge of a tile
     bool m_limit_bounds = false;                   // true to render only the non-empty slide region
     std::pair<int64_t, int64_t> m_l0_offset{0, 0}; // level 0 coordinate offset
-    float m_mpp = 1e-6;
+    float m_mpp = 0.f; // microns per pixel at level 0, 0 if unknown
     int m_levels = 0;                                          // slide levels
     int m_dz_levels = 0;                                       // deepzoom levels
     std::vector<std::pair<int64_t, int64_t>> m_l_dimensions;   // slide level dimensions
@@ -62,5 +182,19 @@ private:
     std::vector<int> m_preferred_slide_levels;                 // preferred slide levels for each deepzoom level
     std::vector<double> m_level_downsamples;                   // slide level downsample factors
     std::vector<double> m_level_dz_downsamples;                // deepzoom level downsample factors
+    std::vector<LevelSelection> m_level_selections;            // slide level selection for each deepzoom level
     std::string m_background_color = "#ffffff";
+    std::shared_ptr<ColorLut const> m_color_lut; // slide ICC profile to sRGB, nullptr if off
+
+    struct CoarseLevels
+    {
+        std::mutex mutex; // held while loading
+        std::atomic<bool> ready{false};
+        std::atomic<bool> failed{false};          // the last load could not read the slide, the next one retries
+        std::vector<std::vector<uint8_t>> images; // one per dz level up to m_coarse_base_level
+    };
+    static constexpr int64_t kMaxCoarseReadPixels = 4096 * 4096;
+    std::shared_ptr<CoarseLevels> m_coarse; // shared so the generator stays movable and get_tile const
+    int m_coarse_base_level = -1;           // largest dz level served from m_coarse, -1 if disabled
+    bool m_coarse_lazy = true;              // as passed to set_coarse_level_cache
 };
@@ -0,0 +1,185 @@
+#include "dzi_writer.hpp"
+#include "content_hash.hpp"
+#include "image_codec.hpp"
+#include "tile_manifest.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    fs::path _tiles_dir(fs::path const& dzi)
+    {
+        return dzi.parent_path() / (dzi.stem().string() + "_files");
+    }
+
+    fs::path _tile_path(fs::path const& tiles_dir, TileIndex const& t)
+    {
+        return tiles_dir / std::to_string(t.level) / (std::to_string(t.col) + "_" + std::to_string(t.row) + ".jpeg");
+    }
+
+    // true if the file of `t` exists and matches the manifest
+    bool _verify(fs::path const& tiles_dir, TileIndex const& t, TileManifest const& manifest)
+    {
+        auto const entry = manifest.find(t);
+        if (!entry) return false;
+        std::ifstream in(_tile_path(tiles_dir, t), std::ios::binary | std::ios::ate);
+        if (!in || static_cast<uint64_t>(in.tellg()) != entry->size) return false;
+        std::vector<uint8_t> data(entry->size);
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(data.data()), data.size())) return false;
+        return content_hash(data) == entry->hash;
+    }
+
+    // the slide and settings the tiles are written with, a manifest with another header describes other tiles
+    std::string _manifest_header(DeepZoomGenerator const& generator, DziOptions const& options)
+    {
+        auto const dzi = generator.get_dzi("jpeg");
+        auto const [x, y] = generator.l0_offset();
+        char descriptor[17];
+        std::snprintf(descriptor, sizeof(descriptor), "%016llx",
+                      static_cast<unsigned long long>(content_hash(reinterpret_cast<uint8_t const*>(dzi.data()),
+                                                                   dzi.size())));
+        return "quickhash " + generator.quickhash() + " dzi " + descriptor + " offset " + std::to_string(x) + " " +
+               std::to_string(y) + " format jpeg quality " + std::to_string(options.quality) + " native-jpeg " +
+               (options.native_jpeg ? "1" : "0");
+    }
+
+    // the tiles of `range` that fail _verify, in range order, checked on all cores
+    std::vector<TileIndex> _missing(TileRange const& range, fs::path const& tiles_dir, TileManifest const& manifest)
+    {
+        std::vector<TileIndex> tiles(range.begin(), range.end());
+        std::vector<char> present(tiles.size());
+        auto const threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < threads; w++)
+            workers.emplace_back([&, w]() {
+                for (auto i = std::size_t{w}; i < tiles.size(); i += threads)
+                    present[i] = _verify(tiles_dir, tiles[i], manifest);
+            });
+        for (auto& worker : workers)
+            worker.join();
+
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < tiles.size(); i++)
+            if (!present[i]) tiles[n++] = tiles[i];
+        tiles.resize(n);
+        return tiles;
+    }
+} // namespace
+
+bool link_tile_file(fs::path const& first, fs::path const& path)
+{
+    std::error_code ec;
+    fs::create_hard_link(first, path, ec);
+    if (!ec) return true;
+    // relative, so the export can still be moved as a whole
+    fs::create_symlink(fs::path("..") / first.parent_path().filename() / first.filename(), path, ec);
+    return !ec;
+}
+
+ExportPassthrough native_jpeg_passthrough(NativeJpegTiles const* native_jpeg)
+{
+    if (!native_jpeg) return {};
+    return [native_jpeg](ExportTile& t) {
+        auto jpeg = native_jpeg->get(t.index.level, static_cast<int>(t.index.col), static_cast<int>(t.index.row));
+        if (!jpeg) return false;
+        t.encoded = std::move(*jpeg);
+        return true;
+    };
+}
+
+std::vector<TileIndex> missing_dzi_tiles(DeepZoomGenerator const& generator, std::string const& dzi_path,
+                                         DziOptions const& options)
+{
+    auto const tiles_dir = _tiles_dir(dzi_path);
+    TileManifest manifest((tiles_dir / "manifest").string());
+    TileRange range(generator.level_tiles(), TileOrder::Hilbert);
+    if (manifest.header() != _manifest_header(generator, options)) return {range.begin(), range.end()};
+    return _missing(range, tiles_dir, manifest);
+}
+
+bool write_dzi(DeepZoomGenerator const& generator, std::string const& dzi_path, DziOptions const& options,
+               ExportStats* stats)
+{
+    auto const dzi = fs::path(dzi_path);
+    auto const tiles_dir = _tiles_dir(dzi);
+    std::error_code ec;
+    // a descriptor left from an earlier run would mark this one complete before it is
+    fs::remove(dzi, ec);
+    for (auto l = 0; l < generator.level_count(); l++)
+        if (fs::create_directories(tiles_dir / std::to_string(l), ec); ec) return false;
+
+    uint32_t background = 0xffffff;
+    if (auto const* p = generator.source().get_property_value(OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); p)
+        background = static_cast<uint32_t>(std::strtoul(p, nullptr, 16));
+
+    TileRange range(generator.level_tiles(), TileOrder::Hilbert);
+    TileManifest manifest((tiles_dir / "manifest").string(), options.checkpoint_tiles);
+    std::vector<TileIndex> tiles;
+    auto const header = _manifest_header(generator, options);
+    if (options.resume && manifest.header() == header)
+        tiles = _missing(range, tiles_dir, manifest);
+    else if (manifest.clear(header))
+        tiles.assign(range.begin(), range.end());
+    else
+        return false;
+
+    auto const total = range.size();
+    auto const skipped = total - static_cast<int64_t>(tiles.size());
+    ContentDedup<fs::path> dedup;
+    std::mutex progress_mutex;
+    int64_t written = skipped;
+
+    auto ok = run_export_pipeline(
+        generator, tiles, options.stages,
+        [&](ExportTile& t) { t.encoded = encode_jpeg(t.pixels, t.width, t.height, options.quality, background); },
+        [&](ExportTile const& t) {
+            if (t.encoded.empty()) return false; // encoding failed
+            auto const path = _tile_path(tiles_dir, t.index);
+            auto const hash = content_hash(t.encoded);
+            auto const size = t.encoded.size();
+            // an earlier run may have left a link here, writing through it would change the tile it points to
+            std::error_code remove_ec;
+            fs::remove(path, remove_ec);
+            auto first = options.dedup ? dedup.find(hash, size) : std::nullopt;
+            if (first && link_tile_file(*first, path))
+                dedup.add_duplicate(size);
+            else
+            {
+                std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                out.write(reinterpret_cast<char const*>(t.encoded.data()), size);
+                out.close();
+                if (!out) return false;
+                if (options.dedup) dedup.insert(hash, size, path);
+            }
+            // recorded only once the file is complete, a tile cut short by a crash is not in the manifest
+            if (!manifest.record(t.index, {size, hash})) return false;
+            if (options.progress)
+            {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                options.progress(++written, total);
+            }
+            return true;
+        },
+        stats, native_jpeg_passthrough(options.native_jpeg));
+    if (stats)
+    {
+        stats->skipped = skipped;
+        stats->dedup = dedup.stats();
+    }
+    if (!manifest.compact() || !ok) return false;
+
+    // the descriptor last, so its presence marks a complete export
+    std::ofstream out(dzi, std::ios::trunc);
+    out << generator.get_dzi("jpeg");
+    out.close();
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "deepzoom.hpp"
+#include "export_pipeline.hpp"
+#include "native_jpeg.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct DziOptions
+{
+    int quality = 75; // JPEG quality
+    ExportStages stages;
+    // skip the tiles an earlier run of the same export wrote, as far as their files still match the manifest
+    // a manifest written for another slide, geometry, quality or native_jpeg setting is discarded and every tile is
+    // rendered again
+    bool resume = false;
+    int checkpoint_tiles = 256; // the manifest is flushed to disk every this many tiles
+    // byte-identical tiles are written once, the other copies become hard links to it (symbolic links where the file
+    // system has no hard links), a tile pack stores them once and shares the offset
+    bool dedup = false;
+    // tiles it can pass through are copied out of the slide file as they are, without rendering or re-encoding (and
+    // so keep the slide's JPEG quality rather than `quality`), every other tile is rendered and encoded as usual
+    // must be built on the exported generator
+    NativeJpegTiles const* native_jpeg = nullptr;
+    // called after every written tile with <tiles written, total tiles>, from the write threads one at a time
+    std::function<void(int64_t, int64_t)> progress;
+};
+
+// export every tile of `generator` as a Deep Zoom image: `dzi_path` (e.g. out/slide.dzi) and the JPEG tiles in
+// out/slide_files/<level>/<col>_<row>.jpeg
+// tiles go through the staged export pipeline in Hilbert order, every written tile is recorded with its size and
+// content hash in the manifest out/slide_files/manifest
+// returns false on I/O error
+bool write_dzi(DeepZoomGenerator const& generator, std::string const& dzi_path, DziOptions const& options = {},
+               ExportStats* stats = nullptr);
+
+// the tiles a resumed write_dzi to `dzi_path` with `options` would render, in export order: those not in the
+// manifest, and those whose file is missing or no longer matches its recorded size and hash, every tile if the
+// manifest was written with other settings
+// only reads the manifest and the tile files, this is the dry run of a resume
+std::vector<TileIndex> missing_dzi_tiles(DeepZoomGenerator const& generator, std::string const& dzi_path,
+                                         DziOptions const& options = {});
+
+// pass-through stage of run_export_pipeline copying the tiles `native_jpeg` can pass through, empty for nullptr
+ExportPassthrough native_jpeg_passthrough(NativeJpegTiles const* native_jpeg);
+
+// tile file `path` as a hard link to the tile file `first`, else as a symbolic link relative to the tile tree, false if
+// the file system supports neither
+bool link_tile_file(std::filesystem::path const& first, std::filesystem::path const& path);
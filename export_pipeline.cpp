@@ -0,0 +1,97 @@
+#include "export_pipeline.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace
+{
+    int _threads(int requested, unsigned fallback)
+    {
+        return requested > 0 ? requested : static_cast<int>(std::max(1u, fallback));
+    }
+
+    // `next` sets the next tile to export, false once there is none left
+    bool _run(DeepZoomGenerator const& generator, std::function<bool(TileIndex&)> const& next,
+              ExportStages const& stages, ExportEncoder const& encode, ExportWriter const& write, ExportStats* stats,
+              ExportPassthrough const& passthrough)
+    {
+        auto const hw = std::max(1u, std::thread::hardware_concurrency());
+        std::atomic<bool> failed{false};
+
+        Pipeline<ExportTile> pipeline;
+        pipeline
+            .add_stage("read", _threads(stages.read_threads, hw),
+                       [&](ExportTile& t) {
+                           if (failed) return false;
+                           t.passed_through = passthrough && passthrough(t);
+                           if (t.passed_through) return true;
+                           t.region = generator.read_tile_region(t.index.level, static_cast<int>(t.index.col),
+                                                                 static_cast<int>(t.index.row));
+                           // a tile of whatever the buffer held must not be written and recorded as done
+                           if (t.region.failed) failed = true;
+                           return !failed;
+                       })
+            .add_stage("convert", _threads(stages.convert_threads, hw / 4),
+                       [&](ExportTile& t) {
+                           if (failed) return false;
+                           if (t.passed_through) return true;
+                           std::tie(t.width, t.height, t.pixels) = generator.convert_tile_region(std::move(t.region));
+                           return true;
+                       })
+            .add_stage("encode", _threads(stages.encode_threads, hw / 2),
+                       [&](ExportTile& t) {
+                           if (failed) return false;
+                           if (t.passed_through) return true;
+                           encode(t);
+                           t.pixels = {};
+                           return true;
+                       })
+            .add_stage("write", _threads(stages.write_threads, 2), [&](ExportTile& t) {
+                if (failed) return false;
+                if (!write(t)) failed = true;
+                return true;
+            });
+
+        pipeline.run([&](ExportTile& t) { return !failed && next(t.index); }, stages.queue_capacity);
+
+        if (stats)
+        {
+            stats->stages = pipeline.stats();
+            stats->tiles = static_cast<int64_t>(stats->stages.back().items);
+            stats->seconds = pipeline.wall_seconds();
+        }
+        return !failed;
+    }
+} // namespace
+
+bool run_export_pipeline(DeepZoomGenerator const& generator, TileRange const& tiles, ExportStages const& stages,
+                         ExportEncoder const& encode, ExportWriter const& write, ExportStats* stats,
+                         ExportPassthrough const& passthrough)
+{
+    auto it = tiles.begin();
+    auto const end = tiles.end();
+    return _run(
+        generator,
+        [&](TileIndex& index) {
+            if (it == end) return false;
+            index = *it++;
+            return true;
+        },
+        stages, encode, write, stats, passthrough);
+}
+
+bool run_export_pipeline(DeepZoomGenerator const& generator, std::vector<TileIndex> const& tiles,
+                         ExportStages const& stages, ExportEncoder const& encode, ExportWriter const& write,
+                         ExportStats* stats, ExportPassthrough const& passthrough)
+{
+    std::size_t i = 0;
+    return _run(
+        generator,
+        [&](TileIndex& index) {
+            if (i == tiles.size()) return false;
+            index = tiles[i++];
+            return true;
+        },
+        stages, encode, write, stats, passthrough);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "content_dedup.hpp"
+#include "deepzoom.hpp"
+#include "pipeline.hpp"
+#include "tile_order.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// threads per export stage, 0 picks a default from the hardware concurrency
+// reads and writes mostly wait on I/O, their threads overlap with the conversion and encoding threads that share
+// the cores
+struct ExportStages
+{
+    int read_threads = 0;            // slide reads, hardware concurrency
+    int convert_threads = 0;         // ARGB to tile bytes and scaling, a quarter of the cores
+    int encode_threads = 0;          // compression, half of the cores
+    int write_threads = 0;           // 2
+    std::size_t queue_capacity = 32; // tiles buffered between two stages
+};
+
+struct ExportStats
+{
+    int64_t tiles = 0;
+    int64_t skipped = 0; // already written by an earlier run
+    double seconds = 0.;
+    std::vector<PipelineStageStats> stages; // read, convert, encode, write
+    DedupStats dedup;                       // written tiles, set by exports with deduplication
+};
+
+// one tile on its way through the export stages
+struct ExportTile
+{
+    TileIndex index;
+    TileRegion region;            // read
+    int width = 0, height = 0;    // convert
+    std::vector<uint8_t> pixels;  // convert, 4 bytes per pixel premultiplied
+    std::vector<uint8_t> encoded; // encode
+    bool passed_through = false;  // read, `encoded` came straight from the slide, convert and encode skip the tile
+};
+
+// fills `tile.encoded` from `tile.pixels`, runs on the encode threads
+using ExportEncoder = std::function<void(ExportTile& tile)>;
+// stores `tile.encoded`, runs on the write threads, returns false on error
+using ExportWriter = std::function<bool(ExportTile const& tile)>;
+// fills `tile.encoded` without rendering (e.g. a native JPEG tile copied out of the slide), runs on the read threads,
+// returns false to render and encode the tile as usual
+using ExportPassthrough = std::function<bool(ExportTile& tile)>;
+
+// renders `tiles` through the read, convert, encode and write stages, each on its own threads with bounded queues in
+// between, so throughput is set by the slowest stage rather than the sum of all of them
+// stops early and returns false once a slide read or the writer failed, the failed tile is never written
+// tiles `passthrough` (if given) fills are not read from the slide, converted or encoded
+bool run_export_pipeline(DeepZoomGenerator const& generator, TileRange const& tiles, ExportStages const& stages,
+                         ExportEncoder const& encode, ExportWriter const& write, ExportStats* stats = nullptr,
+                         ExportPassthrough const& passthrough = {});
+// the same for an explicit list of tiles, in list order
+bool run_export_pipeline(DeepZoomGenerator const& generator, std::vector<TileIndex> const& tiles,
+                         ExportStages const& stages, ExportEncoder const& encode, ExportWriter const& write,
+                         ExportStats* stats = nullptr, ExportPassthrough const& passthrough = {});
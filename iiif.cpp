@@ -0,0 +1,252 @@
+#include "iiif.hpp"
+#include "image_ops.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+    std::vector<std::string> _split(std::string const& s, char sep)
+    {
+        std::vector<std::string> parts;
+        std::size_t pos = 0;
+        while (true)
+        {
+            auto end = s.find(sep, pos);
+            parts.push_back(s.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+            if (end == std::string::npos) break;
+            pos = end + 1;
+        }
+        return parts;
+    }
+
+    // non-negative decimal number, nullopt on garbage
+    std::optional<double> _number(std::string const& s)
+    {
+        if (s.empty()) return std::nullopt;
+        char* end = nullptr;
+        auto v = std::strtod(s.c_str(), &end);
+        if (end != s.c_str() + s.size() || v < 0.) return std::nullopt;
+        return v;
+    }
+
+    std::optional<std::vector<double>> _numbers(std::string const& s, std::size_t n)
+    {
+        auto parts = _split(s, ',');
+        if (parts.size() != n) return std::nullopt;
+        std::vector<double> v;
+        for (auto const& p : parts)
+        {
+            auto d = _number(p);
+            if (!d) return std::nullopt;
+            v.push_back(*d);
+        }
+        return v;
+    }
+
+    int64_t _ceil_div(int64_t a, int64_t b)
+    {
+        return (a + b - 1) / b;
+    }
+} // namespace
+
+IIIFImageService::IIIFImageService(DeepZoomGenerator const& generator, std::string id, TileFetcher fetch,
+                                   int64_t max_area)
+    : m_generator(&generator), m_id(std::move(id)), m_fetch(std::move(fetch)), m_max_area(max_area),
+      m_tile_size(generator.tile_size()), m_overlap(generator.overlap()),
+      m_dzl_dimensions(generator.level_dimensions()), m_t_dimensions(generator.level_tiles())
+{
+    if (!m_fetch)
+        m_fetch = [g = m_generator](int dz_level, int col, int row) { return g->get_tile(dz_level, col, row); };
+    std::tie(m_width, m_height) = m_dzl_dimensions.back();
+}
+
+std::string IIIFImageService::info_json() const
+{
+    // one scale factor per dz level, from full resolution down to the first level that fits into a single tile
+    std::string scale_factors, sizes;
+    for (auto l = static_cast<int>(m_dzl_dimensions.size()) - 1; l >= 0; l--)
+    {
+        auto s = int64_t{1} << (m_dzl_dimensions.size() - 1 - l);
+        scale_factors += (scale_factors.empty() ? "" : ", ") + std::to_string(s);
+        auto const& [w, h] = m_dzl_dimensions[l];
+        if (w <= m_tile_size && h <= m_tile_size)
+            sizes += std::string(sizes.empty() ? "" : ", ") + "{\"width\": " + std::to_string(w) +
+                     ", \"height\": " + std::to_string(h) + "}";
+        if (m_t_dimensions[l].first == 1 && m_t_dimensions[l].second == 1) break;
+    }
+
+    return "{\n  \"@context\": \"http://iiif.io/api/image/3/context.json\",\n  \"id\": \"" + m_id +
+           "\",\n  \"type\": \"ImageService3\",\n  \"protocol\": \"http://iiif.io/api/image\",\n  \"profile\": "
+           "\"level1\",\n  \"width\": " +
+           std::to_string(m_width) + ",\n  \"height\": " + std::to_string(m_height) +
+           ",\n  \"maxArea\": " + std::to_string(m_max_area) + ",\n  \"sizes\": [" + sizes +
+           "],\n  \"tiles\": [{\"width\": " + std::to_string(m_tile_size) + ", \"scaleFactors\": [" + scale_factors +
+           "]}]\n}";
+}
+
+std::optional<IIIFRequest> IIIFImageService::parse(std::string const& path) const
+{
+    auto parts = _split(path.size() && path[0] == '/' ? path.substr(1) : path, '/');
+    if (parts.size() != 4) return std::nullopt;
+    auto const& region = parts[0];
+    auto size = parts[1];
+    auto const& rotation = parts[2];
+    auto dot = parts[3].rfind('.');
+    if (dot == std::string::npos) return std::nullopt;
+
+    IIIFRequest r;
+    r.quality = parts[3].substr(0, dot);
+    r.format = parts[3].substr(dot + 1);
+    if (r.quality != "default" && r.quality != "color") return std::nullopt;
+    if (auto deg = _number(rotation); !deg || std::fmod(*deg, 360.) != 0.) return std::nullopt;
+
+    // region
+    if (region == "full")
+        r.width = m_width, r.height = m_height;
+    else if (region == "square")
+    {
+        auto side = std::min(m_width, m_height);
+        r.x = (m_width - side) / 2, r.y = (m_height - side) / 2, r.width = side, r.height = side;
+    }
+    else
+    {
+        auto pct = region.compare(0, 4, "pct:") == 0;
+        auto v = _numbers(pct ? region.substr(4) : region, 4);
+        if (!v) return std::nullopt;
+        auto const& n = *v;
+        if (pct)
+        {
+            r.x = static_cast<int64_t>(n[0] * m_width / 100.), r.y = static_cast<int64_t>(n[1] * m_height / 100.);
+            r.width = static_cast<int64_t>(std::round(n[2] * m_width / 100.));
+            r.height = static_cast<int64_t>(std::round(n[3] * m_height / 100.));
+        }
+        else
+            r.x = static_cast<int64_t>(n[0]), r.y = static_cast<int64_t>(n[1]), r.width = static_cast<int64_t>(n[2]),
+            r.height = static_cast<int64_t>(n[3]);
+        // clip to the image, a region completely outside of it is an error
+        if (r.x >= m_width || r.y >= m_height || r.width <= 0 || r.height <= 0) return std::nullopt;
+        r.width = std::min(r.width, m_width - r.x), r.height = std::min(r.height, m_height - r.y);
+    }
+
+    // size
+    auto upscale = !size.empty() && size[0] == '^';
+    if (upscale) size = size.substr(1);
+    auto const aspect = static_cast<double>(r.width) / r.height;
+    if (size == "max")
+    {
+        r.out_width = r.width, r.out_height = r.height;
+        // "max" is bounded by maxArea, keep the aspect ratio
+        if (r.out_width * r.out_height > m_max_area)
+        {
+            auto f = std::sqrt(static_cast<double>(m_max_area) / (r.out_width * r.out_height));
+            r.out_width = std::max(int64_t{1}, static_cast<int64_t>(r.out_width * f));
+            r.out_height = std::max(int64_t{1}, static_cast<int64_t>(r.out_height * f));
+        }
+    }
+    else if (size.compare(0, 4, "pct:") == 0)
+    {
+        auto p = _number(size.substr(4));
+        if (!p) return std::nullopt;
+        r.out_width = static_cast<int64_t>(std::round(r.width * *p / 100.));
+        r.out_height = static_cast<int64_t>(std::round(r.height * *p / 100.));
+    }
+    else
+    {
+        auto confined = !size.empty() && size[0] == '!';
+        if (confined) size = size.substr(1);
+        auto comma = size.find(',');
+        if (comma == std::string::npos) return std::nullopt;
+        auto w = _number(size.substr(0, comma));
+        auto h = _number(size.substr(comma + 1));
+        if (confined)
+        {
+            if (!w || !h) return std::nullopt;
+            // largest size fitting into w x h with the region's aspect ratio
+            if (*w / *h > aspect)
+                r.out_height = static_cast<int64_t>(*h), r.out_width = static_cast<int64_t>(std::round(*h * aspect));
+            else
+                r.out_width = static_cast<int64_t>(*w), r.out_height = static_cast<int64_t>(std::round(*w / aspect));
+        }
+        else if (w && h)
+            r.out_width = static_cast<int64_t>(*w), r.out_height = static_cast<int64_t>(*h);
+        else if (w)
+            r.out_width = static_cast<int64_t>(*w), r.out_height = static_cast<int64_t>(std::round(*w / aspect));
+        else if (h)
+            r.out_height = static_cast<int64_t>(*h), r.out_width = static_cast<int64_t>(std::round(*h * aspect));
+        else
+            return std::nullopt;
+    }
+
+    if (r.out_width <= 0 || r.out_height <= 0) return std::nullopt;
+    if (!upscale && (r.out_width > r.width || r.out_height > r.height)) return std::nullopt;
+    if (r.out_width * r.out_height > m_max_area) return std::nullopt;
+    return r;
+}
+
+std::optional<TileIndex> IIIFImageService::tile_for(IIIFRequest const& r) const
+{
+    // the scale factor must be a power of two matching a dz level, with the region on the tile grid of that level
+    auto const levels = static_cast<int>(m_dzl_dimensions.size());
+    for (auto k = 0; k < levels; k++)
+    {
+        auto s = int64_t{1} << k;
+        auto span = m_tile_size * s;
+        if (r.x % span || r.y % span) continue;
+        if (r.width != std::min(span, m_width - r.x) || r.height != std::min(span, m_height - r.y)) continue;
+        if (r.out_width != _ceil_div(r.width, s) || r.out_height != _ceil_div(r.height, s)) continue;
+        return TileIndex{levels - 1 - k, r.x / span, r.y / span};
+    }
+    return std::nullopt;
+}
+
+std::tuple<int, int, std::vector<uint8_t>> IIIFImageService::render(IIIFRequest const& r) const
+{
+    if (auto tile = tile_for(r); tile)
+    {
+        auto [w, h, data] = _tile_without_overlap(tile->level, tile->col, tile->row);
+        if (w != r.out_width || h != r.out_height) data = resize_bgra(data, w, h, r.out_width, r.out_height);
+        return std::make_tuple(static_cast<int>(r.out_width), static_cast<int>(r.out_height), std::move(data));
+    }
+
+    // finest power of two scale that still has at least the requested resolution
+    auto const levels = static_cast<int>(m_dzl_dimensions.size());
+    auto const scale = std::min(static_cast<double>(r.width) / r.out_width, static_cast<double>(r.height) / r.out_height);
+    auto k = 0;
+    while (k + 1 < levels && static_cast<double>(int64_t{1} << (k + 1)) <= scale)
+        k++;
+    auto const s = int64_t{1} << k;
+    auto const dz_level = levels - 1 - k;
+    auto const& [lw, lh] = m_dzl_dimensions[dz_level];
+
+    // the region on that level and the tiles covering it
+    auto x0 = r.x / s, y0 = r.y / s;
+    auto x1 = std::min(lw, _ceil_div(r.x + r.width, s)), y1 = std::min(lh, _ceil_div(r.y + r.height, s));
+    auto cw = x1 - x0, ch = y1 - y0;
+    std::vector<uint8_t> canvas(cw * ch * 4, 0);
+    for (auto row = y0 / m_tile_size; row <= (y1 - 1) / m_tile_size; row++)
+        for (auto col = x0 / m_tile_size; col <= (x1 - 1) / m_tile_size; col++)
+        {
+            auto [tw, th, data] = _tile_without_overlap(dz_level, col, row);
+            blit_bgra(data, tw, th, canvas, cw, ch, col * m_tile_size - x0, row * m_tile_size - y0);
+        }
+
+    return std::make_tuple(static_cast<int>(r.out_width), static_cast<int>(r.out_height),
+                           resize_bgra(canvas, cw, ch, r.out_width, r.out_height));
+}
+
+std::tuple<int64_t, int64_t, std::vector<uint8_t>> IIIFImageService::_tile_without_overlap(int dz_level, int64_t col,
+                                                                                            int64_t row) const
+{
+    auto [w, h, data] = m_fetch(dz_level, static_cast<int>(col), static_cast<int>(row));
+    auto const& [cols, rows] = m_t_dimensions[dz_level];
+    auto const& [lw, lh] = m_dzl_dimensions[dz_level];
+    auto ox = col != 0 ? m_overlap : 0, oy = row != 0 ? m_overlap : 0;
+    auto tw = std::min(m_tile_size, lw - col * m_tile_size), th = std::min(m_tile_size, lh - row * m_tile_size);
+    if (ox == 0 && oy == 0 && tw == w && th == h) return std::make_tuple(tw, th, std::move(data));
+    // tiles are expected at z_size, tolerate anything that is not by resampling first
+    auto ew = tw + ox + (col != cols - 1 ? m_overlap : 0), eh = th + oy + (row != rows - 1 ? m_overlap : 0);
+    if (w != ew || h != eh) data = resize_bgra(data, w, h, ew, eh);
+    return std::make_tuple(tw, th, crop_bgra(data, ew, ox, oy, tw, th));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "deepzoom.hpp"
+#include "tile_order.hpp"
+
+#include <functional>
+#include <optional>
+
+// parsed "{region}/{size}/{rotation}/{quality}.{format}" of an IIIF Image API 3.0 image request
+// region and size are resolved against the full image, only rotation 0 is supported
+struct IIIFRequest
+{
+    int64_t x = 0, y = 0, width = 0, height = 0; // region in full resolution pixels
+    int64_t out_width = 0, out_height = 0;       // requested output size
+    std::string quality = "default";
+    std::string format = "jpg";
+};
+
+// IIIF Image API 3.0 (level 1) on top of a DeepZoomGenerator
+// requests that line up with the deepzoom tile grid are answered from a single dz tile (overlap cropped), other
+// requests are stitched from the tiles of the closest dz level at or above the requested resolution and resampled,
+// so both protocols share whatever tile cache sits behind `fetch`
+class IIIFImageService
+{
+public:
+    // same signature as DeepZoomGenerator::get_tile: <width, height, ARGB_Premultiplied_bytes>
+    using TileFetcher = std::function<std::tuple<int, int, std::vector<uint8_t>>(int dz_level, int col, int row)>;
+
+    // `fetch` defaults to generator.get_tile, the generator must outlive the service
+    IIIFImageService(DeepZoomGenerator const& generator, std::string id, TileFetcher fetch = {},
+                     int64_t max_area = 4096 * 4096);
+
+    // info.json
+    std::string info_json() const;
+    // `path` is the part of the URL after the identifier, nullopt if the request is invalid or unsupported
+    std::optional<IIIFRequest> parse(std::string const& path) const;
+    // the dz tile answering the request as is, if the request is aligned with the tile grid
+    std::optional<TileIndex> tile_for(IIIFRequest const& request) const;
+    // <width, height, ARGB_Premultiplied_bytes>
+    std::tuple<int, int, std::vector<uint8_t>> render(IIIFRequest const& request) const;
+
+private:
+    // the dz tile without its overlap, <width, height, bytes>
+    std::tuple<int64_t, int64_t, std::vector<uint8_t>> _tile_without_overlap(int dz_level, int64_t col,
+                                                                              int64_t row) const;
+
+private:
+    DeepZoomGenerator const* m_generator = nullptr;
+    std::string m_id;
+    TileFetcher m_fetch;
+    int64_t m_max_area = 0;
+    int64_t m_width = 0;  // full resolution width
+    int64_t m_height = 0; // full resolution height
+    int64_t m_tile_size = 0;
+    int m_overlap = 0;
+    std::vector<std::pair<int64_t, int64_t>> m_dzl_dimensions;
+    std::vector<std::pair<int64_t, int64_t>> m_t_dimensions;
+};
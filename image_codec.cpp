@@ -0,0 +1,141 @@
+#include "image_codec.hpp"
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <jpeglib.h>
+
+namespace
+{
+    // libjpeg's default error_exit calls exit(), this one jumps back to the setjmp in _compress / _decompress
+    struct JpegError
+    {
+        jpeg_error_mgr mgr; // first, libjpeg only knows this part
+        std::jmp_buf jump;
+    };
+
+    [[noreturn]] void _error_exit(j_common_ptr cinfo)
+    {
+        std::longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+    }
+
+    // the failure is returned to the caller instead of printed
+    void _output_message(j_common_ptr) {}
+
+    jpeg_error_mgr* _error_mgr(JpegError& error)
+    {
+        auto* mgr = jpeg_std_error(&error.mgr);
+        mgr->error_exit = _error_exit;
+        mgr->output_message = _output_message;
+        return mgr;
+    }
+
+    // no objects with destructors live in the frames a longjmp skips, `rgb` and the output belong to the caller
+    bool _compress(jpeg_compress_struct& cinfo, JpegError& error, uint8_t const* bgra, int width, int height,
+                   int quality, uint32_t background, std::vector<uint8_t>& rgb, unsigned char** buffer,
+                   unsigned long* size)
+    {
+        if (setjmp(error.jump)) return false;
+        jpeg_create_compress(&cinfo);
+        jpeg_mem_dest(&cinfo, buffer, size);
+
+        cinfo.image_width = width;
+        cinfo.image_height = height;
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, quality, TRUE);
+
+        jpeg_start_compress(&cinfo, TRUE);
+
+        uint32_t const bg[3] = {(background >> 16) & 0xff, (background >> 8) & 0xff, background & 0xff};
+        while (cinfo.next_scanline < cinfo.image_height)
+        {
+            uint8_t const* src = bgra + static_cast<size_t>(cinfo.next_scanline) * width * 4;
+            uint8_t* dest = rgb.data();
+            for (int n = 0; n < width; n++)
+            {
+                // premultiplied: c + bg * (1 - a)
+                uint32_t const inv_a = 255 - src[3];
+                dest[0] = static_cast<uint8_t>(src[2] + (bg[0] * inv_a + 127) / 255);
+                dest[1] = static_cast<uint8_t>(src[1] + (bg[1] * inv_a + 127) / 255);
+                dest[2] = static_cast<uint8_t>(src[0] + (bg[2] * inv_a + 127) / 255);
+                dest += 3;
+                src += 4;
+            }
+
+            JSAMPROW row_ptr = rgb.data();
+            jpeg_write_scanlines(&cinfo, &row_ptr, 1);
+        }
+
+        jpeg_finish_compress(&cinfo);
+        return true;
+    }
+
+    bool _decompress(jpeg_decompress_struct& cinfo, JpegError& error, uint8_t const* data, std::size_t size,
+                     std::vector<uint8_t>& bgra, std::vector<uint8_t>& rgb)
+    {
+        if (setjmp(error.jump)) return false;
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, data, static_cast<unsigned long>(size));
+        jpeg_read_header(&cinfo, TRUE);
+        cinfo.out_color_space = JCS_RGB;
+        jpeg_start_decompress(&cinfo);
+
+        int const width = cinfo.output_width;
+        bgra.resize(static_cast<size_t>(width) * cinfo.output_height * 4);
+        rgb.resize(static_cast<size_t>(width) * 3);
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            uint8_t* dest = bgra.data() + static_cast<size_t>(cinfo.output_scanline) * width * 4;
+            JSAMPROW row_ptr = rgb.data();
+            jpeg_read_scanlines(&cinfo, &row_ptr, 1);
+            uint8_t const* src = rgb.data();
+            for (int n = 0; n < width; n++)
+            {
+                dest[0] = src[2];
+                dest[1] = src[1];
+                dest[2] = src[0];
+                dest[3] = 255;
+                dest += 4;
+                src += 3;
+            }
+        }
+
+        jpeg_finish_decompress(&cinfo);
+        return true;
+    }
+} // namespace
+
+std::vector<uint8_t> encode_jpeg(uint8_t const* bgra, int width, int height, int quality, uint32_t background)
+{
+    jpeg_compress_struct cinfo{};
+    JpegError error;
+    cinfo.err = _error_mgr(error);
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * 3);
+    auto const ok = _compress(cinfo, error, bgra, width, height, quality, background, rgb, &buffer, &size);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> out;
+    if (ok) out.assign(buffer, buffer + size);
+    free(buffer);
+    return out;
+}
+
+std::tuple<int, int, std::vector<uint8_t>> decode_jpeg(uint8_t const* data, std::size_t size)
+{
+    jpeg_decompress_struct cinfo{};
+    JpegError error;
+    cinfo.err = _error_mgr(error);
+    std::vector<uint8_t> bgra, rgb;
+    // libjpeg only warns about truncated or damaged entropy data and fills in gray, that is corrupt as well
+    auto const ok = _decompress(cinfo, error, data, size, bgra, rgb) && error.mgr.num_warnings == 0;
+    int const width = ok ? static_cast<int>(cinfo.output_width) : 0;
+    int const height = ok ? static_cast<int>(cinfo.output_height) : 0;
+    jpeg_destroy_decompress(&cinfo);
+    if (!ok) bgra.clear();
+    return std::make_tuple(width, height, std::move(bgra));
+}
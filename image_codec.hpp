@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+// JPEG encoding of the 4 bytes per pixel premultiplied buffers returned by DeepZoomGenerator::get_tile
+// transparent pixels are composited over `background` (0xRRGGBB), empty if libjpeg fails
+std::vector<uint8_t> encode_jpeg(uint8_t const* bgra, int width, int height, int quality = 75,
+                                 uint32_t background = 0xffffff);
+inline std::vector<uint8_t> encode_jpeg(std::vector<uint8_t> const& bgra, int width, int height, int quality = 75,
+                                        uint32_t background = 0xffffff)
+{
+    return encode_jpeg(bgra.data(), width, height, quality, background);
+}
+
+// <width, height, 4 bytes per pixel> from a JPEG, opaque, <0, 0, empty> if the JPEG is corrupt
+std::tuple<int, int, std::vector<uint8_t>> decode_jpeg(uint8_t const* data, std::size_t size);
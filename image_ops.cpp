@@ -0,0 +1,104 @@
+#include "image_ops.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    struct Tap
+    {
+        int64_t index;
+        float weight;
+    };
+
+    // for each destination sample, the source samples contributing to it
+    std::vector<std::vector<Tap>> _make_taps(int64_t src_n, int64_t dst_n)
+    {
+        std::vector<std::vector<Tap>> taps(dst_n);
+        auto const scale = static_cast<double>(src_n) / dst_n;
+        for (int64_t i = 0; i < dst_n; i++)
+        {
+            auto& t = taps[i];
+            if (scale > 1.)
+            {
+                // box filter over the covered source interval
+                auto lo = i * scale, hi = (i + 1) * scale;
+                for (auto s = static_cast<int64_t>(lo); s < std::min(src_n, static_cast<int64_t>(std::ceil(hi))); s++)
+                {
+                    auto cover = std::min(hi, s + 1.) - std::max(lo, static_cast<double>(s));
+                    if (cover > 0.) t.push_back({s, static_cast<float>(cover / scale)});
+                }
+            }
+            else
+            {
+                // bilinear between the two nearest source centers
+                auto c = std::clamp((i + 0.5) * scale - 0.5, 0., static_cast<double>(src_n - 1));
+                auto s0 = static_cast<int64_t>(c);
+                auto s1 = std::min(s0 + 1, src_n - 1);
+                auto f = static_cast<float>(c - s0);
+                t.push_back({s0, 1.f - f});
+                if (s1 != s0 && f > 0.f) t.push_back({s1, f});
+            }
+        }
+        return taps;
+    }
+} // namespace
+
+std::vector<uint8_t> crop_bgra(std::vector<uint8_t> const& src, int64_t src_w, int64_t x, int64_t y, int64_t w,
+                               int64_t h)
+{
+    std::vector<uint8_t> out(w * h * 4);
+    for (int64_t j = 0; j < h; j++)
+        std::memcpy(out.data() + j * w * 4, src.data() + ((y + j) * src_w + x) * 4, w * 4);
+    return out;
+}
+
+void blit_bgra(std::vector<uint8_t> const& src, int64_t src_w, int64_t src_h, std::vector<uint8_t>& dst, int64_t dst_w,
+               int64_t dst_h, int64_t x, int64_t y)
+{
+    auto x0 = std::max(int64_t{0}, x), y0 = std::max(int64_t{0}, y);
+    auto x1 = std::min(dst_w, x + src_w), y1 = std::min(dst_h, y + src_h);
+    if (x1 <= x0 || y1 <= y0) return;
+    for (auto j = y0; j < y1; j++)
+        std::memcpy(dst.data() + (j * dst_w + x0) * 4, src.data() + ((j - y) * src_w + (x0 - x)) * 4, (x1 - x0) * 4);
+}
+
+std::vector<uint8_t> resize_bgra(std::vector<uint8_t> const& src, int64_t src_w, int64_t src_h, int64_t dst_w,
+                                 int64_t dst_h)
+{
+    if (src_w == dst_w && src_h == dst_h) return src;
+    std::vector<uint8_t> out(dst_w * dst_h * 4);
+    if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) return out;
+
+    auto const x_taps = _make_taps(src_w, dst_w);
+    auto const y_taps = _make_taps(src_h, dst_h);
+
+    // horizontal pass into a float buffer of dst_w x src_h, then vertical pass into the output
+    std::vector<float> tmp(dst_w * src_h * 4);
+    for (int64_t j = 0; j < src_h; j++)
+    {
+        auto const* row = src.data() + j * src_w * 4;
+        auto* t = tmp.data() + j * dst_w * 4;
+        for (int64_t i = 0; i < dst_w; i++)
+        {
+            float acc[4] = {0.f, 0.f, 0.f, 0.f};
+            for (auto const& tap : x_taps[i])
+                for (auto c = 0; c < 4; c++)
+                    acc[c] += row[tap.index * 4 + c] * tap.weight;
+            std::copy(acc, acc + 4, t + i * 4);
+        }
+    }
+    for (int64_t j = 0; j < dst_h; j++)
+    {
+        auto* o = out.data() + j * dst_w * 4;
+        for (int64_t i = 0; i < dst_w * 4; i++)
+        {
+            float acc = 0.f;
+            for (auto const& tap : y_taps[j])
+                acc += tmp[tap.index * dst_w * 4 + i] * tap.weight;
+            o[i] = static_cast<uint8_t>(std::clamp(acc + 0.5f, 0.f, 255.f));
+        }
+    }
+    return out;
+}
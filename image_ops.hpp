@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// helpers for the 4 bytes per pixel buffers returned by DeepZoomGenerator::get_tile (b, g, r, a in memory)
+
+// copy the w x h rectangle at (x, y) out of `src`, the rectangle must lie inside the source
+std::vector<uint8_t> crop_bgra(std::vector<uint8_t> const& src, int64_t src_w, int64_t x, int64_t y, int64_t w,
+                               int64_t h);
+
+// copy `src` into `dst` with its top left corner at (x, y), clipped to the destination
+void blit_bgra(std::vector<uint8_t> const& src, int64_t src_w, int64_t src_h, std::vector<uint8_t>& dst, int64_t dst_w,
+               int64_t dst_h, int64_t x, int64_t y);
+
+// separable resize, area average when shrinking and bilinear when enlarging
+std::vector<uint8_t> resize_bgra(std::vector<uint8_t> const& src, int64_t src_w, int64_t src_h, int64_t dst_w,
+                                 int64_t dst_h);
@@ -1,6 +1,6 @@
 #include "deepzoom.hpp"
+#include "image_codec.hpp"
 #include <iostream>
-#include <jpeglib.h>
 
 std::string ARGB32_To_JPEG_Base64(std::vector<uint8_t> const& argb_bytes, int width, int height, int quality = 75);
 std::string Base64_Encode(unsigned char const* src, size_t len);
@@ -14,37 +14,38 @@ int main(int argc, char* argv[])
     }
 
     std::string url = argv[1];
-    openslide_t* slide = openslide_open(url.c_str());
-    if (!slide)
+    // `synthetic:<width>x<height>` opens a procedural slide instead of a file
+    auto source = open_slide_source(url);
+    if (!source)
     {
-        std::cerr << "Failed to open slide: " << openslide_get_error(slide) << std::endl;
+        std::cerr << "Failed to open slide: " << url << std::endl;
         return -1;
     }
     else
     {
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_VENDOR); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_VENDOR); p)
             std::cout << "Slide Vendor: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_COMMENT); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_COMMENT); p)
             std::cout << "Slide Comment: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); p)
             std::cout << "Background Color: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_MPP_X); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_MPP_X); p)
             std::cout << "MPP_X: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_MPP_Y); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_MPP_Y); p)
             std::cout << "MPP_Y: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_WIDTH); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_WIDTH); p)
             std::cout << "Bounds Width: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_HEIGHT); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_HEIGHT); p)
             std::cout << "Bounds Height: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_X); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_X); p)
             std::cout << "Bounds X: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_BOUNDS_Y); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_BOUNDS_Y); p)
             std::cout << "Bounds Y: " << p << std::endl;
-        if (auto const* p = openslide_get_property_value(slide, OPENSLIDE_PROPERTY_NAME_OBJECTIVE_POWER); p)
+        if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_OBJECTIVE_POWER); p)
             std::cout << "Objective Power: " << p << std::endl;
     }
 
-    DeepZoomGenerator slide_handler(slide, 254, 1);
+    DeepZoomGenerator slide_handler(source, 254, 1);
     std::cout << slide_handler.get_dzi("jpeg") << std::endl;
 
     auto const& [width, height, argb_bytes] = slide_handler.get_tile(slide_handler.level_count() / 2, 0, 0);
@@ -52,63 +53,14 @@ int main(int argc, char* argv[])
     // you can check the base64 string in a browser by pasting it into the address bar
     std::cout << ARGB32_To_JPEG_Base64(argb_bytes, width, height) << std::endl;
 
-    // notice: the slide must be closed after use
-    openslide_close(slide);
-    slide = nullptr;
-
+    // notice: the openslide handle is closed when the last reference to `source` (including the generator's) goes away
     return 0;
 }
 
 std::string ARGB32_To_JPEG_Base64(std::vector<uint8_t> const& argb_bytes, int width, int height, int quality)
 {
-    jpeg_compress_struct cinfo;
-    jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-
-    unsigned char* mem_buffer = nullptr;
-    unsigned long encoded_size;
-    jpeg_mem_dest(&cinfo, &mem_buffer, &encoded_size);
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE);
-
-    jpeg_start_compress(&cinfo, TRUE);
-
-    std::vector<uint8_t> rgb(width * 3);
-    while (cinfo.next_scanline < cinfo.image_height)
-    {
-        int j = cinfo.next_scanline;
-        int n = width;
-        uint8_t const* argb = argb_bytes.data() + j * width * 4 - 1;
-        uint8_t* dest = rgb.data();
-        while (--n >= 0)
-        {
-            // swap and convert ARGB to RGB
-            dest[0] = argb[3];
-            dest[1] = argb[2];
-            dest[2] = argb[1];
-            dest += 3;
-            argb += 4;
-        }
-
-        JSAMPROW row_ptr = rgb.data();
-        jpeg_write_scanlines(&cinfo, &row_ptr, 1);
-    }
-
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
-
-    auto str = "data:image/jpg;base64," + Base64_Encode(mem_buffer, encoded_size);
-
-    free(mem_buffer);
-
-    return str;
+    auto jpeg = encode_jpeg(argb_bytes, width, height, quality);
+    return "data:image/jpg;base64," + Base64_Encode(jpeg.data(), jpeg.size());
 }
 
 /*
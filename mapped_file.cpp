@@ -0,0 +1,110 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+#ifdef _WIN32
+
+std::unique_ptr<MappedFile> MappedFile::create(std::string const& path, uint64_t size)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    file->m_size = size;
+    file->m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file->m_file == INVALID_HANDLE_VALUE)
+    {
+        file->m_file = nullptr;
+        return nullptr;
+    }
+    if (size == 0) return file;
+    file->m_mapping = CreateFileMappingA(file->m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                         static_cast<DWORD>(size), nullptr);
+    if (!file->m_mapping) return nullptr;
+    file->m_data = static_cast<uint8_t*>(MapViewOfFile(file->m_mapping, FILE_MAP_WRITE, 0, 0, 0));
+    if (!file->m_data) return nullptr;
+    return file;
+}
+
+bool MappedFile::flush(uint64_t offset, uint64_t size) const
+{
+    if (!m_data || offset >= m_size) return m_data != nullptr;
+    return FlushViewOfFile(m_data + offset, static_cast<SIZE_T>(std::min(size, m_size - offset))) != 0;
+}
+
+bool MappedFile::close()
+{
+    auto ok = true;
+    if (m_data)
+    {
+        ok = FlushViewOfFile(m_data, 0) != 0 && FlushFileBuffers(m_file) != 0;
+        ok = UnmapViewOfFile(m_data) != 0 && ok;
+        m_data = nullptr;
+    }
+    if (m_mapping) CloseHandle(m_mapping);
+    m_mapping = nullptr;
+    if (m_file) ok = CloseHandle(m_file) != 0 && ok;
+    m_file = nullptr;
+    return ok;
+}
+
+#else
+
+std::unique_ptr<MappedFile> MappedFile::create(std::string const& path, uint64_t size)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    file->m_size = size;
+    file->m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file->m_fd < 0 || ::ftruncate(file->m_fd, static_cast<off_t>(size)) != 0) return nullptr;
+    if (size == 0) return file;
+    auto* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->m_fd, 0);
+    if (data == MAP_FAILED) return nullptr;
+    file->m_data = static_cast<uint8_t*>(data);
+    return file;
+}
+
+bool MappedFile::flush(uint64_t offset, uint64_t size) const
+{
+    if (!m_data || offset >= m_size) return m_data != nullptr;
+    // msync wants a page aligned start
+    auto const page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    auto const start = offset / page * page;
+    auto const end = std::min(m_size, offset + size);
+    // MS_ASYNC does not start write back on Linux, dirty pages would pile up until the kernel's own limits
+    if (::msync(m_data + start, end - start, MS_SYNC) != 0) return false;
+    // the clean pages wholly inside the range leave the process, pages shared with a neighbouring range stay
+    auto const first = (offset + page - 1) / page * page;
+    auto const last = end == m_size ? end : end / page * page;
+    if (last > first) ::madvise(m_data + first, last - first, MADV_DONTNEED);
+    return true;
+}
+
+bool MappedFile::close()
+{
+    auto ok = true;
+    if (m_data)
+    {
+        ok = ::msync(m_data, m_size, MS_SYNC) == 0;
+        ok = ::munmap(m_data, m_size) == 0 && ok;
+        m_data = nullptr;
+    }
+    if (m_fd >= 0) ok = ::close(m_fd) == 0 && ok;
+    m_fd = -1;
+    return ok;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// writable memory mapping of a whole file, POSIX mmap or a Windows file mapping
+// pages are written back by the OS as it sees fit, flush() writes a finished range back right away
+class MappedFile
+{
+public:
+    // creates or truncates `path` to `size` bytes and maps it, nullptr on error
+    static std::unique_ptr<MappedFile> create(std::string const& path, uint64_t size);
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    uint8_t* data() const { return m_data; }
+    uint64_t size() const { return m_size; }
+    // synchronous write back of [offset, offset + size), then the pages wholly inside it are dropped from the
+    // mapping (they stay in the file and are read back on access), returns false on error
+    bool flush(uint64_t offset, uint64_t size) const;
+    // synchronous write back of everything and unmap, returns false on error
+    bool close();
+
+private:
+    MappedFile() = default;
+
+private:
+    uint8_t* m_data = nullptr;
+    uint64_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
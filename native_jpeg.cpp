@@ -0,0 +1,276 @@
+#include "native_jpeg.hpp"
+#include "image_codec.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    // the parts of a TIFF directory needed to locate JPEG tiles
+    struct TiffDirectory
+    {
+        int64_t width = 0, height = 0;
+        int64_t tile_width = 0, tile_height = 0;
+        int compression = 1;
+        int photometric = -1;
+        int samples_per_pixel = 1;
+        int planar_config = 1;
+        std::vector<uint64_t> tile_offsets;
+        std::vector<uint64_t> tile_byte_counts;
+        std::vector<uint8_t> jpeg_tables;
+    };
+
+    class TiffParser
+    {
+    public:
+        explicit TiffParser(std::ifstream& file) : m_file(file) {}
+
+        // every directory of the main IFD chain, empty if the file is not a TIFF
+        std::vector<TiffDirectory> directories()
+        {
+            std::vector<TiffDirectory> dirs;
+            uint8_t header[16];
+            if (!_read(0, header, 16)) return dirs;
+            if (header[0] == 'I' && header[1] == 'I')
+                m_little = true;
+            else if (header[0] == 'M' && header[1] == 'M')
+                m_little = false;
+            else
+                return dirs;
+            auto const version = _uint(header + 2, 2);
+            uint64_t next = 0;
+            if (version == 42)
+                next = _uint(header + 4, 4);
+            else if (version == 43)
+                m_big = true, next = _uint(header + 8, 8);
+            else
+                return dirs;
+
+            // a corrupt chain could loop, no slide has anywhere near this many directories
+            while (next != 0 && dirs.size() < 1024)
+            {
+                auto dir = _directory(next);
+                if (!dir) break;
+                dirs.push_back(std::move(*dir));
+            }
+            return dirs;
+        }
+
+    private:
+        bool _read(uint64_t offset, uint8_t* dest, std::size_t size)
+        {
+            m_file.clear();
+            m_file.seekg(static_cast<std::streamoff>(offset));
+            return static_cast<bool>(m_file.read(reinterpret_cast<char*>(dest), size));
+        }
+
+        uint64_t _uint(uint8_t const* p, int size) const
+        {
+            uint64_t v = 0;
+            for (auto i = 0; i < size; i++)
+                v |= static_cast<uint64_t>(p[m_little ? i : size - 1 - i]) << (8 * i);
+            return v;
+        }
+
+        static int _type_size(int type)
+        {
+            switch (type)
+            {
+            case 1: // BYTE
+            case 2: // ASCII
+            case 7: // UNDEFINED
+                return 1;
+            case 3: // SHORT
+                return 2;
+            case 4:  // LONG
+            case 13: // IFD
+                return 4;
+            case 16: // LONG8
+            case 18: // IFD8
+                return 8;
+            default:
+                return 0;
+            }
+        }
+
+        // reads the directory at `offset` and sets `offset` to the next one
+        std::optional<TiffDirectory> _directory(uint64_t& offset)
+        {
+            auto const count_size = m_big ? 8 : 2, entry_size = m_big ? 20 : 12, field_size = m_big ? 8 : 4;
+            uint8_t buf[8];
+            if (!_read(offset, buf, count_size)) return std::nullopt;
+            auto const count = _uint(buf, count_size);
+            if (count > 4096) return std::nullopt;
+            std::vector<uint8_t> entries(count * entry_size + field_size);
+            if (!_read(offset + count_size, entries.data(), entries.size())) return std::nullopt;
+
+            TiffDirectory dir;
+            for (uint64_t e = 0; e < count; e++)
+            {
+                auto const* p = entries.data() + e * entry_size;
+                auto const tag = _uint(p, 2);
+                auto const type = static_cast<int>(_uint(p + 2, 2));
+                auto const n = _uint(p + 4, field_size);
+                auto const* field = p + 4 + field_size;
+                auto const size = _type_size(type);
+                if (size == 0 || n > (uint64_t{1} << 28)) continue;
+
+                // values inline in the entry, or at an offset
+                std::vector<uint8_t> data(n * size);
+                if (data.size() <= static_cast<std::size_t>(field_size))
+                    std::memcpy(data.data(), field, data.size());
+                else if (!_read(_uint(field, field_size), data.data(), data.size()))
+                    return std::nullopt;
+                auto values = [&]() {
+                    std::vector<uint64_t> v(n);
+                    for (uint64_t i = 0; i < n; i++)
+                        v[i] = _uint(data.data() + i * size, size);
+                    return v;
+                };
+                auto value = [&]() { return n > 0 ? _uint(data.data(), size) : 0; };
+
+                switch (tag)
+                {
+                case 256:
+                    dir.width = value();
+                    break;
+                case 257:
+                    dir.height = value();
+                    break;
+                case 259:
+                    dir.compression = static_cast<int>(value());
+                    break;
+                case 262:
+                    dir.photometric = static_cast<int>(value());
+                    break;
+                case 277:
+                    dir.samples_per_pixel = static_cast<int>(value());
+                    break;
+                case 284:
+                    dir.planar_config = static_cast<int>(value());
+                    break;
+                case 322:
+                    dir.tile_width = value();
+                    break;
+                case 323:
+                    dir.tile_height = value();
+                    break;
+                case 324:
+                    dir.tile_offsets = values();
+                    break;
+                case 325:
+                    dir.tile_byte_counts = values();
+                    break;
+                case 347:
+                    dir.jpeg_tables = std::move(data);
+                    break;
+                default:
+                    break;
+                }
+            }
+            offset = _uint(entries.data() + count * entry_size, field_size);
+            return dir;
+        }
+
+    private:
+        std::ifstream& m_file;
+        bool m_little = true;
+        bool m_big = false;
+    };
+
+    // Adobe APP14 with transform 0, tells decoders the 3 components are RGB and must not be converted from YCbCr
+    constexpr uint8_t kAdobeRgbMarker[] = {0xff, 0xee, 0x00, 0x0e, 'A',  'd',  'o',  'b',
+                                           'e',  0x00, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00};
+} // namespace
+
+NativeJpegTiles::NativeJpegTiles(DeepZoomGenerator const& generator, std::string const& slide_path)
+    : m_generator(&generator), m_levels(generator.level_count())
+{
+    auto const& source = generator.source();
+    if (auto const* p = source.get_property_value(OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); p)
+        m_background = static_cast<uint32_t>(std::strtoul(p, nullptr, 16));
+
+    // only formats where the TIFF tiles are the slide pixels as openslide returns them
+    auto const* vendor = source.get_property_value(OPENSLIDE_PROPERTY_NAME_VENDOR);
+    if (!vendor || (std::strcmp(vendor, "aperio") != 0 && std::strcmp(vendor, "generic-tiff") != 0)) return;
+    // the dz grid must be the native grid, the color LUT can still change so available() checks it
+    if (generator.overlap() != 0 || generator.l0_offset() != std::make_pair(int64_t{0}, int64_t{0})) return;
+
+    m_file.open(slide_path, std::ios::binary);
+    if (!m_file) return;
+    auto const dirs = TiffParser(m_file).directories();
+
+    auto const ts = generator.tile_size();
+    auto const dz_dimensions = generator.level_dimensions();
+    auto const slide_levels = generator.preferred_slide_levels();
+    for (auto dz = 0; dz < generator.level_count(); dz++)
+    {
+        // read 1:1 from its slide level
+        auto const level_dimensions = source.get_level_dimensions(slide_levels[dz]);
+        if (dz_dimensions[dz] != level_dimensions) continue;
+        for (auto const& d : dirs)
+        {
+            if (d.width != level_dimensions.first || d.height != level_dimensions.second) continue;
+            if (d.tile_width != ts || d.tile_height != ts || d.compression != 7 || d.samples_per_pixel != 3 ||
+                d.planar_config != 1 || (d.photometric != 2 && d.photometric != 6))
+                continue;
+            Level level;
+            level.width = d.width;
+            level.height = d.height;
+            level.tiles_across = (d.width + ts - 1) / ts;
+            level.offsets = d.tile_offsets;
+            level.byte_counts = d.tile_byte_counts;
+            level.jpeg_tables = d.jpeg_tables;
+            level.rgb = d.photometric == 2;
+            auto const tiles = static_cast<std::size_t>(level.tiles_across * ((d.height + ts - 1) / ts));
+            if (level.offsets.size() < tiles || level.byte_counts.size() < tiles) continue;
+            m_levels[dz] = std::move(level);
+            break;
+        }
+    }
+}
+
+bool NativeJpegTiles::available(int dz_level) const
+{
+    return dz_level >= 0 && dz_level < static_cast<int>(m_levels.size()) && m_levels[dz_level].has_value() &&
+           !m_generator->color_lut();
+}
+
+std::optional<std::vector<uint8_t>> NativeJpegTiles::get(int dz_level, int col, int row) const
+{
+    if (!available(dz_level)) return std::nullopt;
+    auto const& level = *m_levels[dz_level];
+    auto const ts = m_generator->tile_size();
+    // edge tiles are padded in the TIFF but cropped in deepzoom
+    if (int64_t{col + 1} * ts > level.width || int64_t{row + 1} * ts > level.height || col < 0 || row < 0)
+        return std::nullopt;
+    auto const index = static_cast<std::size_t>(row * level.tiles_across + col);
+    auto const offset = level.offsets[index];
+    auto const size = level.byte_counts[index];
+    if (size < 4) return std::nullopt; // sparse tile
+
+    std::vector<uint8_t> tile(size);
+    {
+        std::lock_guard<std::mutex> lock(m_file_mutex);
+        m_file.clear();
+        m_file.seekg(static_cast<std::streamoff>(offset));
+        if (!m_file.read(reinterpret_cast<char*>(tile.data()), size)) return std::nullopt;
+    }
+    if (tile[0] != 0xff || tile[1] != 0xd8) return std::nullopt;
+
+    // SOI, [APP14], tables without their SOI and EOI, then the tile without its SOI
+    std::vector<uint8_t> jpeg{0xff, 0xd8};
+    if (level.rgb) jpeg.insert(jpeg.end(), std::begin(kAdobeRgbMarker), std::end(kAdobeRgbMarker));
+    if (auto const& t = level.jpeg_tables; t.size() > 4) jpeg.insert(jpeg.end(), t.begin() + 2, t.end() - 2);
+    jpeg.insert(jpeg.end(), tile.begin() + 2, tile.end());
+    m_passthrough++;
+    return jpeg;
+}
+
+std::vector<uint8_t> NativeJpegTiles::get_jpeg(int dz_level, int col, int row, int quality) const
+{
+    if (auto jpeg = get(dz_level, col, row); jpeg) return std::move(*jpeg);
+    m_fallback++;
+    auto [w, h, data] = m_generator->get_tile(dz_level, col, row);
+    return encode_jpeg(data, w, h, quality, m_background);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "deepzoom.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// JPEG dz tiles copied straight out of TIFF based slides (Aperio SVS, generic tiled TIFF) where a dz tile is exactly
+// one native JPEG tile: the dz level is read 1:1 from a slide level, the tile sizes match, there is no overlap or
+// bounds offset, no color management, and the tile is not a padded edge tile
+// such tiles skip decoding, conversion and re-encoding entirely and suffer no generation loss
+class NativeJpegTiles
+{
+public:
+    // `slide_path` is the file `generator`'s source was opened from, the generator must outlive this object
+    NativeJpegTiles(DeepZoomGenerator const& generator, std::string const& slide_path);
+
+    NativeJpegTiles(NativeJpegTiles const&) = delete;
+    NativeJpegTiles& operator=(NativeJpegTiles const&) = delete;
+
+    // true if tiles of `dz_level` can be passed through, checked on every call as a color LUT set on the generator
+    // later turns pass-through off
+    bool available(int dz_level) const;
+    // the native tile as a standalone JPEG (JPEG tables spliced in), std::nullopt if it cannot be passed through
+    std::optional<std::vector<uint8_t>> get(int dz_level, int col, int row) const;
+    // get, or DeepZoomGenerator::get_tile encoded at `quality` where pass-through does not apply
+    std::vector<uint8_t> get_jpeg(int dz_level, int col, int row, int quality = 75) const;
+
+    uint64_t passthrough_count() const { return m_passthrough; }
+    uint64_t fallback_count() const { return m_fallback; }
+
+private:
+    // a tiled, JPEG compressed TIFF directory matching one dz level
+    struct Level
+    {
+        int64_t width = 0, height = 0;
+        int64_t tiles_across = 0;
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> byte_counts;
+        std::vector<uint8_t> jpeg_tables; // abbreviated table stream, empty if every tile is self-contained
+        bool rgb = false;                 // JPEG data is RGB rather than YCbCr
+    };
+
+    DeepZoomGenerator const* m_generator = nullptr;
+    std::vector<std::optional<Level>> m_levels; // per dz level
+    uint32_t m_background = 0xffffff;
+    mutable std::mutex m_file_mutex;
+    mutable std::ifstream m_file;
+    mutable std::atomic<uint64_t> m_passthrough{0};
+    mutable std::atomic<uint64_t> m_fallback{0};
+};
@@ -0,0 +1,115 @@
+#include "npy_writer.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // NPY format 1.0: magic, version, little endian header length, then a python dict literal padded with spaces and
+    // a newline so the array data starts 64 byte aligned
+    std::string _npy_header(int64_t height, int64_t width, int channels)
+    {
+        auto dict = "{'descr': '|u1', 'fortran_order': False, 'shape': (" + std::to_string(height) + ", " +
+                    std::to_string(width) + ", " + std::to_string(channels) + "), }";
+        std::size_t const prefix = 10;
+        dict.append((64 - (prefix + dict.size() + 1) % 64) % 64, ' ');
+        dict += '\n';
+        std::string header("\x93NUMPY\x01\x00", 8);
+        header += static_cast<char>(dict.size() & 0xff);
+        header += static_cast<char>(dict.size() >> 8);
+        return header + dict;
+    }
+
+    // premultiplied b, g, r, a to `channels` bytes per pixel
+    void _convert_row(uint8_t const* bgra, int64_t n, int channels, uint8_t* out)
+    {
+        if (channels == 4)
+        {
+            for (int64_t i = 0; i < n; i++, bgra += 4, out += 4)
+            {
+                out[0] = bgra[2];
+                out[1] = bgra[1];
+                out[2] = bgra[0];
+                out[3] = bgra[3];
+            }
+            return;
+        }
+        for (int64_t i = 0; i < n; i++, bgra += 4, out += 3)
+        {
+            auto const white = 255 - bgra[3];
+            out[0] = static_cast<uint8_t>(std::min(255, bgra[2] + white));
+            out[1] = static_cast<uint8_t>(std::min(255, bgra[1] + white));
+            out[2] = static_cast<uint8_t>(std::min(255, bgra[0] + white));
+        }
+    }
+} // namespace
+
+bool write_npy(DeepZoomGenerator const& generator, int dz_level, std::string const& path,
+               NpyExportOptions const& options, ExportStats* stats)
+{
+    if (dz_level < 0 || dz_level >= generator.level_count()) return false;
+    if (options.channels != 3 && options.channels != 4) return false;
+    auto const [level_w, level_h] = generator.level_dimensions()[dz_level];
+    auto const x = options.x, y = options.y;
+    if (x < 0 || y < 0 || x >= level_w || y >= level_h) return false;
+    auto const w = options.width > 0 ? std::min(options.width, level_w - x) : level_w - x;
+    auto const h = options.height > 0 ? std::min(options.height, level_h - y) : level_h - y;
+    auto const channels = options.channels;
+
+    auto const header = _npy_header(h, w, channels);
+    auto const row_bytes = static_cast<uint64_t>(w) * channels;
+    auto file = MappedFile::create(path, header.size() + row_bytes * h);
+    if (!file) return false;
+    std::memcpy(file->data(), header.data(), header.size());
+    auto* const pixels = file->data() + header.size();
+
+    // the tiles overlapping the region, row by row
+    int64_t const ts = generator.tile_size();
+    auto const overlap = generator.overlap();
+    auto const col0 = x / ts, col1 = (x + w - 1) / ts;
+    auto const row0 = y / ts, row1 = (y + h - 1) / ts;
+    std::vector<TileIndex> tiles;
+    for (auto row = row0; row <= row1; row++)
+        for (auto col = col0; col <= col1; col++)
+            tiles.push_back({dz_level, col, row});
+
+    auto stages = options.stages;
+    if (stages.write_threads <= 0) stages.write_threads = 1;
+    std::mutex strip_mutex;
+    std::vector<int64_t> strip_tiles(row1 - row0 + 1, 0); // tiles copied per tile row
+    int64_t rows_written = 0;
+
+    auto ok = run_export_pipeline(
+        generator, tiles, stages,
+        [&](ExportTile& t) {
+            // the tile without its overlap, cut to the region, copied straight into the mapped array
+            auto const core_x = t.index.col * ts, core_y = t.index.row * ts;
+            auto const ix0 = std::max(core_x, x), ix1 = std::min(std::min(core_x + ts, level_w), x + w);
+            auto const iy0 = std::max(core_y, y), iy1 = std::min(std::min(core_y + ts, level_h), y + h);
+            auto const offset_x = core_x - (t.index.col != 0 ? overlap : 0);
+            auto const offset_y = core_y - (t.index.row != 0 ? overlap : 0);
+            for (auto iy = iy0; iy < iy1; iy++)
+                _convert_row(t.pixels.data() + ((iy - offset_y) * t.width + (ix0 - offset_x)) * 4, ix1 - ix0,
+                             channels, pixels + (iy - y) * row_bytes + (ix0 - x) * channels);
+        },
+        [&](ExportTile const& t) {
+            {
+                std::lock_guard<std::mutex> lock(strip_mutex);
+                if (++strip_tiles[t.index.row - row0] < col1 - col0 + 1) return true;
+            }
+            // a whole strip is in place, write it back and drop it from memory, outside the lock so the write
+            // threads flush strips in parallel
+            auto const strip_y0 = std::max(t.index.row * ts, y), strip_y1 = std::min((t.index.row + 1) * ts, y + h);
+            auto const rows = strip_y1 - strip_y0;
+            auto flushed = file->flush(header.size() + (strip_y0 - y) * row_bytes, rows * row_bytes);
+            std::lock_guard<std::mutex> lock(strip_mutex);
+            rows_written += rows;
+            if (options.progress) options.progress(rows_written, h);
+            return flushed;
+        },
+        stats);
+    return file->close() && ok;
+}
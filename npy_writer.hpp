@@ -0,0 +1,28 @@
+#pragma once
+
+#include "export_pipeline.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct NpyExportOptions
+{
+    // region of the dz level in level pixels, a width or height of 0 extends it to the level edge
+    int64_t x = 0, y = 0, width = 0, height = 0;
+    // 3: r, g, b composited over white, 4: r, g, b, a premultiplied as rendered
+    int channels = 3;
+    ExportStages stages;
+    // called after every tile row with <rows written, total rows> of the region
+    std::function<void(int64_t, int64_t)> progress;
+};
+
+// writes a region of one dz level as a single uint8 array of shape (height, width, channels) to a .npy file, which
+// numpy.load(path, mmap_mode="r") and other readers can map without loading it
+// the file is mapped and the tiles of the region are rendered through the export pipeline and copied into place
+// without their overlap, so memory use is bounded by the pipeline queues and not by the size of the region
+// finished tile rows are written back as horizontal strips and dropped from the mapping, so the mapped pages do not
+// grow with the region either
+// returns false on I/O error or if the region is empty or outside the level
+bool write_npy(DeepZoomGenerator const& generator, int dz_level, std::string const& path,
+               NpyExportOptions const& options = {}, ExportStats* stats = nullptr);
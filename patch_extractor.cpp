@@ -0,0 +1,244 @@
+#include "patch_extractor.hpp"
+#include "image_ops.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <future>
+
+namespace
+{
+    bool _is_tissue(uint32_t argb)
+    {
+        auto const a = static_cast<int>(argb >> 24);
+        if (a < 128) return false;
+        // composited over white
+        auto const r = static_cast<int>((argb >> 16) & 0xff) + 255 - a;
+        auto const g = static_cast<int>((argb >> 8) & 0xff) + 255 - a;
+        auto const b = static_cast<int>(argb & 0xff) + 255 - a;
+        auto const lo = std::min({r, g, b}), hi = std::max({r, g, b});
+        return lo < 210 || hi - lo > 30;
+    }
+
+    // premultiplied b, g, r, a bytes composited over white to r, g, b
+    void _bgra_to_rgb(uint8_t const* bgra, int64_t n, uint8_t* rgb)
+    {
+        for (int64_t i = 0; i < n; i++, bgra += 4, rgb += 3)
+        {
+            auto const white = 255 - bgra[3];
+            rgb[0] = static_cast<uint8_t>(std::min(255, bgra[2] + white));
+            rgb[1] = static_cast<uint8_t>(std::min(255, bgra[1] + white));
+            rgb[2] = static_cast<uint8_t>(std::min(255, bgra[0] + white));
+        }
+    }
+} // namespace
+
+TissueMask::TissueMask(SlideSource const& source, int64_t max_pixels)
+{
+    auto const levels = source.get_level_count();
+    if (levels <= 0 || max_pixels <= 0) return;
+    auto level = levels - 1;
+    for (auto l = 0; l < levels; l++)
+    {
+        auto const [w, h] = source.get_level_dimensions(l);
+        if (w * h <= max_pixels)
+        {
+            level = l;
+            break;
+        }
+    }
+    auto const [level_width, level_height] = source.get_level_dimensions(level);
+    if (level_width <= 0 || level_height <= 0) return;
+    // a level still too large is reduced by `factor`, a mask pixel is tissue if most of its block is
+    int64_t factor = 1;
+    while (((level_width + factor - 1) / factor) * ((level_height + factor - 1) / factor) > max_pixels)
+        factor++;
+    m_width = (level_width + factor - 1) / factor;
+    m_height = (level_height + factor - 1) / factor;
+    auto const level_downsample = source.get_level_downsample(level);
+    m_downsample = level_downsample * factor;
+
+    // bands of whole mask rows of about a million level pixels, so memory stays bounded whatever the level size
+    auto const band = std::max<int64_t>(1, (int64_t{1} << 20) / (level_width * factor));
+    std::vector<uint32_t> argb(level_width * factor * band);
+    std::vector<int64_t> counts(m_width);
+    m_sum.assign((m_width + 1) * (m_height + 1), 0);
+    for (int64_t y0 = 0; y0 < m_height; y0 += band)
+    {
+        auto const first = y0 * factor;
+        auto const rows = std::min(band * factor, level_height - first);
+        auto const l0_y = static_cast<int64_t>(std::llround(first * level_downsample));
+        if (!source.read_region(argb.data(), 0, l0_y, level, level_width, rows))
+        {
+            m_sum.clear();
+            return;
+        }
+        for (auto y = y0; y < std::min(m_height, y0 + band); y++)
+        {
+            auto const r0 = (y - y0) * factor, r1 = std::min(rows, r0 + factor);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (auto r = r0; r < r1; r++)
+                for (int64_t x = 0; x < level_width; x++)
+                    counts[x / factor] += _is_tissue(argb[r * level_width + x]);
+            uint64_t row = 0;
+            for (int64_t x = 0; x < m_width; x++)
+            {
+                auto const block = (r1 - r0) * std::min(factor, level_width - x * factor);
+                row += 2 * counts[x] >= block;
+                m_sum[(y + 1) * (m_width + 1) + x + 1] = m_sum[y * (m_width + 1) + x + 1] + row;
+            }
+        }
+    }
+}
+
+double TissueMask::fraction(int64_t x, int64_t y, int64_t w, int64_t h) const
+{
+    if (!ok() || w <= 0 || h <= 0) return 0.;
+    // mask pixels touched by the rectangle, at least one
+    auto x0 = static_cast<int64_t>(std::floor(x / m_downsample));
+    auto y0 = static_cast<int64_t>(std::floor(y / m_downsample));
+    auto x1 = std::max(x0 + 1, static_cast<int64_t>(std::ceil((x + w) / m_downsample)));
+    auto y1 = std::max(y0 + 1, static_cast<int64_t>(std::ceil((y + h) / m_downsample)));
+    auto const area = static_cast<double>((x1 - x0) * (y1 - y0));
+    x0 = std::clamp<int64_t>(x0, 0, m_width);
+    x1 = std::clamp<int64_t>(x1, 0, m_width);
+    y0 = std::clamp<int64_t>(y0, 0, m_height);
+    y1 = std::clamp<int64_t>(y1, 0, m_height);
+    auto const stride = m_width + 1;
+    auto const tissue = m_sum[y1 * stride + x1] - m_sum[y0 * stride + x1] - m_sum[y1 * stride + x0] +
+                        m_sum[y0 * stride + x0];
+    return tissue / area;
+}
+
+PatchExtractor::PatchExtractor(DeepZoomGenerator const& generator, PatchOptions const& options, int threads)
+    : m_generator(generator), m_options(options), m_threads(threads)
+{
+    auto const& source = generator.source();
+    if (generator.mpp() <= 0. || options.mpp <= 0. || options.size <= 0 || source.get_level_count() <= 0) return;
+    m_l0_size = options.size * options.mpp / generator.mpp();
+    // level downsamples are rarely exact powers of two, allow them to be 1% coarser than needed
+    m_slide_level = std::max(0, source.get_best_level_for_downsample(m_l0_size / options.size * 1.01));
+    m_read_size = std::max<int64_t>(1, std::llround(m_l0_size / source.get_level_downsample(m_slide_level)));
+    if (options.min_tissue > 0.)
+    {
+        m_mask = std::make_unique<TissueMask>(source);
+        if (!m_mask->ok()) return;
+    }
+    m_ok = true;
+}
+
+double PatchExtractor::tissue_fraction(PatchLocation const& location) const
+{
+    if (!m_mask) return 1.;
+    auto const size = static_cast<int64_t>(std::ceil(m_l0_size));
+    return m_mask->fraction(location.x, location.y, size, size);
+}
+
+std::vector<PatchLocation> PatchExtractor::filter(std::vector<PatchLocation> const& locations) const
+{
+    if (!m_mask) return locations;
+    std::vector<PatchLocation> kept;
+    for (auto const& location : locations)
+        if (tissue_fraction(location) >= m_options.min_tissue) kept.push_back(location);
+    return kept;
+}
+
+std::vector<PatchLocation> PatchExtractor::grid(int64_t stride) const
+{
+    std::vector<PatchLocation> locations;
+    if (!m_ok) return locations;
+    auto const size = static_cast<int64_t>(std::ceil(m_l0_size));
+    if (stride <= 0) stride = size;
+    // the largest dz level is level 0 cut to the bounds
+    auto const [w, h] = m_generator.level_dimensions().back();
+    auto const [ox, oy] = m_generator.l0_offset();
+    for (int64_t y = 0; y + size <= h; y += stride)
+        for (int64_t x = 0; x + size <= w; x += stride)
+            locations.push_back({ox + x, oy + y});
+    return filter(locations);
+}
+
+bool PatchExtractor::read(PatchLocation const& location, uint8_t* out) const
+{
+    if (!m_ok) return false;
+    auto const n = m_read_size * m_read_size;
+    std::vector<uint32_t> argb(n);
+    if (!m_generator.source().read_region(argb.data(), location.x, location.y, m_slide_level, m_read_size,
+                                          m_read_size))
+    {
+        std::memset(out, 255, patch_bytes());
+        return false;
+    }
+    std::vector<uint8_t> bgra(n * 4);
+    if (auto const& lut = m_generator.color_lut(); lut)
+        lut->apply(argb.data(), bgra.data(), n);
+    else
+        for (int64_t i = 0; i < n; i++)
+        {
+            auto const p = argb[i];
+            bgra[i * 4] = static_cast<uint8_t>(p);
+            bgra[i * 4 + 1] = static_cast<uint8_t>(p >> 8);
+            bgra[i * 4 + 2] = static_cast<uint8_t>(p >> 16);
+            bgra[i * 4 + 3] = static_cast<uint8_t>(p >> 24);
+        }
+    auto const size = m_options.size;
+    if (m_read_size != size) bgra = resize_bgra(bgra, m_read_size, m_read_size, size, size);
+    _bgra_to_rgb(bgra.data(), static_cast<int64_t>(size) * size, out);
+    return true;
+}
+
+bool PatchExtractor::extract(PatchLocation const* locations, std::size_t count, uint8_t* batch) const
+{
+    if (!m_ok) return false;
+    std::call_once(m_pool_once, [this]() { m_pool = std::make_unique<ThreadPool>(m_threads); });
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> ok{true};
+    auto work = [&]() {
+        for (auto i = next++; i < count; i = next++)
+            if (!read(locations[i], batch + i * patch_bytes())) ok = false;
+    };
+    std::vector<std::future<void>> workers;
+    auto const n = std::min<std::size_t>(count, m_pool->size());
+    for (std::size_t w = 0; w < n; w++)
+        workers.push_back(m_pool->submit(work));
+    for (auto& worker : workers)
+        worker.get();
+    return ok;
+}
+
+int64_t PatchExtractor::extract_batches(std::vector<PatchLocation> const& locations,
+                                        std::function<bool(PatchBatch const&)> const& consume) const
+{
+    if (!m_ok) return 0;
+    auto const kept = filter(locations);
+    auto const batch_size = std::max<std::size_t>(1, m_options.batch_size);
+    std::vector<uint8_t> buffers[2] = {std::vector<uint8_t>(batch_size * patch_bytes()),
+                                       std::vector<uint8_t>(batch_size * patch_bytes())};
+    auto start = [&](std::size_t first, int buffer) {
+        return std::async(std::launch::async, [&, first, buffer]() {
+            extract(kept.data() + first, std::min(batch_size, kept.size() - first), buffers[buffer].data());
+        });
+    };
+
+    int64_t handed_out = 0;
+    std::future<void> pending;
+    if (!kept.empty()) pending = start(0, 0);
+    for (std::size_t first = 0, b = 0; first < kept.size(); first += batch_size, b ^= 1)
+    {
+        pending.get();
+        if (first + batch_size < kept.size()) pending = start(first + batch_size, static_cast<int>(b ^ 1));
+        PatchBatch batch;
+        batch.data = buffers[b].data();
+        batch.locations = kept.data() + first;
+        batch.count = std::min(batch_size, kept.size() - first);
+        batch.size = m_options.size;
+        handed_out += static_cast<int64_t>(batch.count);
+        if (!consume(batch))
+        {
+            if (pending.valid()) pending.get();
+            break;
+        }
+    }
+    return handed_out;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "deepzoom.hpp"
+#include "thread_pool.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct PatchOptions
+{
+    double mpp = 0.5;         // microns per pixel of the patches
+    int size = 224;           // patch width and height in pixels
+    double min_tissue = 0.5;  // patches with a smaller tissue fraction are skipped, 0 keeps everything
+    std::size_t batch_size = 64;
+};
+
+// top left corner of a patch in level 0 slide coordinates
+struct PatchLocation
+{
+    int64_t x = 0;
+    int64_t y = 0;
+};
+
+// `count` patches of size x size x 3 (r, g, b) bytes back to back, NHWC with N = count
+struct PatchBatch
+{
+    uint8_t const* data = nullptr;
+    PatchLocation const* locations = nullptr;
+    std::size_t count = 0;
+    int size = 0;
+};
+
+// tissue mask of a whole slide built from a low resolution level, read one mask row at a time
+// a pixel is tissue if it is opaque and either darker than light background or clearly colored, the fraction of
+// tissue in any rectangle comes from a summed area table in constant time
+class TissueMask
+{
+public:
+    // from the finest slide level of at most `max_pixels` pixels; if none is that small, the coarsest level is reduced
+    // in blocks to at most `max_pixels` mask pixels
+    explicit TissueMask(SlideSource const& source, int64_t max_pixels = int64_t{2048} * 2048);
+
+    bool ok() const { return !m_sum.empty(); }
+    double downsample() const { return m_downsample; }
+    // fraction of tissue in the level 0 rectangle, 0 outside the slide
+    double fraction(int64_t x, int64_t y, int64_t w, int64_t h) const;
+
+private:
+    double m_downsample = 1.;
+    int64_t m_width = 0, m_height = 0;
+    std::vector<uint64_t> m_sum; // (m_width + 1) x (m_height + 1), row and column 0 are zeros
+};
+
+// fixed size patches at a target resolution for training and inference pipelines
+// each patch is read from the slide level closest to the target mpp without being coarser, then resampled to
+// exactly `size` pixels (area average when shrinking, bilinear when the slide is coarser than the target), composited
+// over white and written as RGB straight into the caller's batch buffer
+// patches are read in parallel on a thread pool started by the first extract(); every method is thread safe
+class PatchExtractor
+{
+public:
+    // ok() is false if the slide has no mpp
+    PatchExtractor(DeepZoomGenerator const& generator, PatchOptions const& options, int threads = 0);
+
+    bool ok() const { return m_ok; }
+    PatchOptions const& options() const { return m_options; }
+    // slide level the patches are read from
+    int slide_level() const { return m_slide_level; }
+    // width and height of a patch in level 0 pixels
+    double l0_size() const { return m_l0_size; }
+    std::size_t patch_bytes() const { return static_cast<std::size_t>(m_options.size) * m_options.size * 3; }
+
+    // tissue fraction of the patch at `location` from the tissue mask, 1 if min_tissue is 0
+    double tissue_fraction(PatchLocation const& location) const;
+    // the locations passing the tissue filter, in order
+    std::vector<PatchLocation> filter(std::vector<PatchLocation> const& locations) const;
+    // non-overlapping patches over the slide (its bounds with limit_bounds) passing the tissue filter, row by row
+    // a `stride` in level 0 pixels other than 0 overrides the patch size
+    std::vector<PatchLocation> grid(int64_t stride = 0) const;
+
+    // reads one patch into `out` (patch_bytes()) on the calling thread, false if the slide read failed
+    bool read(PatchLocation const& location, uint8_t* out) const;
+    // reads `count` patches into `batch`, which holds count * patch_bytes(), no tissue filtering
+    // returns false if a slide read failed, the patch is left white
+    bool extract(PatchLocation const* locations, std::size_t count, uint8_t* batch) const;
+    // extracts the locations passing the tissue filter batch_size at a time into two buffers allocated once: the next
+    // batch is read while `consume` looks at the current one, so a buffer is only valid during its call
+    // stops early if `consume` returns false, returns the number of patches handed out
+    int64_t extract_batches(std::vector<PatchLocation> const& locations,
+                            std::function<bool(PatchBatch const&)> const& consume) const;
+
+private:
+    DeepZoomGenerator const& m_generator;
+    PatchOptions m_options;
+    bool m_ok = false;
+    int m_slide_level = 0;
+    double m_l0_size = 0.;  // patch extent in level 0 pixels
+    int64_t m_read_size = 0; // patch extent in slide level pixels
+    std::unique_ptr<TissueMask> m_mask; // only with min_tissue > 0
+    int m_threads = 0;
+    mutable std::once_flag m_pool_once;
+    mutable std::unique_ptr<ThreadPool> m_pool;
+};
@@ -0,0 +1,267 @@
+#include "patch_sampler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+
+struct PatchSampler::State
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::vector<uint8_t>> owned; // buffers allocated by the sampler
+    std::vector<uint8_t*> buffers;
+    std::deque<int> free;
+    std::deque<std::unique_ptr<SampledBatch>> ready;
+    int held = 0; // handed out by next(), not released yet
+    bool done = false;
+    bool stop = false;
+    double wait_seconds = 0.;
+};
+
+PatchSampler::PatchSampler(std::vector<DeepZoomGenerator const*> slides, std::vector<SampleLocation> locations,
+                           PatchSamplerOptions const& options)
+    : m_slides(std::move(slides)), m_options(options), m_locations(std::move(locations))
+{
+    _start();
+}
+
+PatchSampler::PatchSampler(std::vector<DeepZoomGenerator const*> slides, SamplingPolicy const& policy,
+                           PatchSamplerOptions const& options)
+    : m_slides(std::move(slides)), m_options(options), m_policy_enabled(true), m_policy(policy), m_rng(options.seed)
+{
+    std::vector<double> weights(m_slides.size(), 1.);
+    for (std::size_t s = 0; s < m_slides.size(); s++)
+    {
+        if (s < policy.slide_weights.size()) weights[s] = std::max(0., policy.slide_weights[s]);
+        if (weights[s] > 0. && !_extractor(static_cast<uint32_t>(s), policy.mpp)) weights[s] = 0.;
+    }
+    m_masks.resize(m_slides.size());
+    if (policy.min_tissue > 0.)
+        for (std::size_t s = 0; s < m_slides.size(); s++)
+            if (weights[s] > 0.)
+            {
+                m_masks[s] = std::make_unique<TissueMask>(m_slides[s]->source());
+                if (!m_masks[s]->ok()) weights[s] = 0.;
+            }
+    // nothing to draw from leaves the distribution empty and the sampler ends right away
+    if (std::accumulate(weights.begin(), weights.end(), 0.) > 0.)
+        m_pick_slide = std::discrete_distribution<int>(weights.begin(), weights.end());
+    else
+        m_policy_enabled = false;
+    _start();
+}
+
+PatchSampler::~PatchSampler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->stop = true;
+    }
+    m_state->cv.notify_all();
+    if (m_producer.joinable()) m_producer.join();
+}
+
+std::size_t PatchSampler::batch_bytes() const
+{
+    return m_options.batch_size * m_options.size * m_options.size * 3;
+}
+
+int PatchSampler::held() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->held;
+}
+
+double PatchSampler::wait_seconds() const
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->wait_seconds;
+}
+
+void PatchSampler::_start()
+{
+    m_options.batch_size = std::max<std::size_t>(1, m_options.batch_size);
+    m_options.prefetch_batches = std::max(1, m_options.prefetch_batches);
+    m_state = std::make_shared<State>();
+    for (auto b = 0; b < m_options.prefetch_batches; b++)
+    {
+        if (m_options.allocate)
+            m_state->buffers.push_back(m_options.allocate(batch_bytes()));
+        else
+        {
+            m_state->owned.emplace_back(batch_bytes());
+            m_state->buffers.push_back(m_state->owned.back().data());
+        }
+        m_state->free.push_back(b);
+    }
+    m_pool = std::make_unique<ThreadPool>(m_options.threads);
+    m_producer = std::thread([this]() { _produce(); });
+}
+
+std::shared_ptr<SampledBatch const> PatchSampler::next()
+{
+    auto const start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    // with every buffer held by the caller the producer cannot read another batch, waiting would never end
+    auto const all_held = [this]() { return m_state->held == static_cast<int>(m_state->buffers.size()); };
+    m_state->cv.wait(lock, [&]() { return !m_state->ready.empty() || m_state->done || all_held(); });
+    m_state->wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (m_state->ready.empty()) return nullptr;
+    auto batch = std::move(m_state->ready.front());
+    m_state->ready.pop_front();
+    m_state->held++;
+    m_low_tissue += batch->low_tissue;
+    // the buffer goes back to the producer once the last copy of the pointer is gone
+    return std::shared_ptr<SampledBatch const>(batch.release(), [state = m_state](SampledBatch const* b) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->free.push_back(b->buffer);
+            state->held--;
+        }
+        state->cv.notify_all();
+        delete b;
+    });
+}
+
+void PatchSampler::_produce()
+{
+    while (true)
+    {
+        std::size_t low_tissue = 0;
+        auto locations = _next_locations(low_tissue);
+        if (locations.empty()) break;
+        auto batch = std::make_unique<SampledBatch>();
+        {
+            std::unique_lock<std::mutex> lock(m_state->mutex);
+            m_state->cv.wait(lock, [this]() { return m_state->stop || !m_state->free.empty(); });
+            if (m_state->stop) return;
+            batch->buffer = m_state->free.front();
+            m_state->free.pop_front();
+            batch->data = m_state->buffers[batch->buffer];
+        }
+        batch->count = locations.size();
+        batch->size = m_options.size;
+        batch->locations = std::move(locations);
+        batch->low_tissue = low_tissue;
+        _read(*batch);
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            m_state->ready.push_back(std::move(batch));
+        }
+        m_state->cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->done = true;
+    }
+    m_state->cv.notify_all();
+}
+
+std::vector<SampleLocation> PatchSampler::_next_locations(std::size_t& low_tissue)
+{
+    std::vector<SampleLocation> locations;
+    if (m_policy_enabled)
+    {
+        locations.resize(m_options.batch_size);
+        for (auto& location : locations)
+        {
+            auto tissue = true;
+            if (!_draw(location, tissue)) return {};
+            low_tissue += !tissue;
+        }
+        return locations;
+    }
+    auto const n = std::min(m_options.batch_size, m_locations.size() - m_next);
+    locations.assign(m_locations.begin() + m_next, m_locations.begin() + m_next + n);
+    m_next += n;
+    return locations;
+}
+
+bool PatchSampler::_draw(SampleLocation& location, bool& tissue)
+{
+    location.slide = static_cast<uint32_t>(m_pick_slide(m_rng));
+    location.mpp = m_policy.mpp;
+    auto const* extractor = _extractor(location.slide, location.mpp);
+    if (!extractor) return false;
+    auto const size = static_cast<int64_t>(std::ceil(extractor->l0_size()));
+    auto const [w, h] = m_slides[location.slide]->level_dimensions().back();
+    auto const [ox, oy] = m_slides[location.slide]->l0_offset();
+    std::uniform_int_distribution<int64_t> pick_x(ox, ox + std::max<int64_t>(0, w - size));
+    std::uniform_int_distribution<int64_t> pick_y(oy, oy + std::max<int64_t>(0, h - size));
+    auto const* mask = m_masks[location.slide].get();
+    tissue = false;
+    for (auto attempt = 0; attempt < std::max(1, m_policy.max_attempts) && !tissue; attempt++)
+    {
+        location.x = pick_x(m_rng);
+        location.y = pick_y(m_rng);
+        tissue = !mask || mask->fraction(location.x, location.y, size, size) >= m_policy.min_tissue;
+    }
+    // the last draw is kept anyway, counted as low tissue
+    return true;
+}
+
+PatchExtractor const* PatchSampler::_extractor(uint32_t slide, double mpp)
+{
+    if (slide >= m_slides.size()) return nullptr;
+    auto& extractor = m_extractors[{slide, mpp}];
+    if (!extractor)
+    {
+        PatchOptions options;
+        options.mpp = mpp;
+        options.size = m_options.size;
+        options.min_tissue = 0.;
+        extractor = std::make_unique<PatchExtractor>(*m_slides[slide], options);
+    }
+    return extractor->ok() ? extractor.get() : nullptr;
+}
+
+void PatchSampler::_read(SampledBatch& batch)
+{
+    auto const patch_bytes = static_cast<std::size_t>(batch.size) * batch.size * 3;
+    std::vector<PatchExtractor const*> extractors(batch.count);
+    for (std::size_t i = 0; i < batch.count; i++)
+        extractors[i] = _extractor(batch.locations[i].slide, batch.locations[i].mpp);
+
+    // read order: by slide and resolution, then in bands of one patch height left to right
+    std::vector<std::size_t> order(batch.count);
+    std::iota(order.begin(), order.end(), 0);
+    auto key = [&](std::size_t i) {
+        auto const& l = batch.locations[i];
+        auto const band = extractors[i] ? static_cast<int64_t>(l.y / extractors[i]->l0_size()) : 0;
+        return std::make_tuple(l.slide, l.mpp, band, l.x);
+    };
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return key(a) < key(b); });
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> ok{true};
+    auto work = [&]() {
+        for (auto k = next++; k < order.size(); k = next++)
+        {
+            auto const i = order[k];
+            auto const& l = batch.locations[i];
+            auto* out = batch.data + i * patch_bytes;
+            if (!extractors[i])
+            {
+                std::memset(out, 255, patch_bytes);
+                ok = false;
+            }
+            else if (!extractors[i]->read({l.x, l.y}, out))
+                ok = false;
+        }
+    };
+    std::vector<std::future<void>> workers;
+    auto const n = std::min<std::size_t>(order.size(), m_pool->size());
+    for (std::size_t w = 0; w < n; w++)
+        workers.push_back(m_pool->submit(work));
+    for (auto& worker : workers)
+        worker.get();
+    batch.ok = ok;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "patch_extractor.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// one patch to read: its slide (index into the sampler's slides), top left corner in level 0 coordinates and mpp
+struct SampleLocation
+{
+    uint32_t slide = 0;
+    int64_t x = 0;
+    int64_t y = 0;
+    double mpp = 0.5;
+};
+
+// random locations drawn when the sampler is given no list
+struct SamplingPolicy
+{
+    double mpp = 0.5;
+    double min_tissue = 0.5;           // tissue fraction of a drawn patch, from each slide's TissueMask
+    std::vector<double> slide_weights; // relative sampling frequency per slide, empty for uniform
+    int max_attempts = 100;            // draws per patch before the tissue check is given up, see low_tissue
+};
+
+struct PatchSamplerOptions
+{
+    int size = 224;
+    std::size_t batch_size = 64;
+    int prefetch_batches = 4; // batches read ahead, also the number of batch buffers
+    int threads = 0;          // readers, 0 for one per core
+    uint32_t seed = 0;        // SamplingPolicy draws
+    // memory for one batch of batch_size * size * size * 3 bytes, e.g. a pinned tensor of the training framework, so
+    // batches are read straight into it; called prefetch_batches times up front, the memory stays the caller's
+    // unset: the sampler allocates the buffers itself
+    std::function<uint8_t*(std::size_t bytes)> allocate;
+};
+
+// a batch handed out by PatchSampler, NHWC r, g, b bytes in one of the sampler's buffers
+struct SampledBatch
+{
+    uint8_t* data = nullptr;
+    std::size_t count = 0;
+    int size = 0;
+    std::vector<SampleLocation> locations; // in batch order
+    bool ok = true;                        // false if a patch could not be read, it is left white
+    int buffer = 0;                        // which of the prefetch_batches buffers holds the data
+    // drawn patches kept below SamplingPolicy::min_tissue after max_attempts draws
+    std::size_t low_tissue = 0;
+};
+
+// feeds training loops with batches of patches from many slides
+// a background thread assembles the batches in order and reads each on a thread pool, sorted by slide, resolution and
+// position so neighbouring patches are read one after the other and share the slide's decoded tiles
+// up to prefetch_batches batches are read ahead; a buffer is reused once the shared_ptr of its batch is released, so a
+// caller can hold at most prefetch_batches batches at a time
+class PatchSampler
+{
+public:
+    // one pass over `locations` in the given order (shuffle beforehand for training)
+    PatchSampler(std::vector<DeepZoomGenerator const*> slides, std::vector<SampleLocation> locations,
+                 PatchSamplerOptions const& options);
+    // endless random patches drawn by `policy`, slides without mpp are never drawn
+    PatchSampler(std::vector<DeepZoomGenerator const*> slides, SamplingPolicy const& policy,
+                 PatchSamplerOptions const& options);
+    // stops reading ahead, batches still held stay valid
+    ~PatchSampler();
+
+    PatchSampler(PatchSampler const&) = delete;
+    PatchSampler& operator=(PatchSampler const&) = delete;
+
+    // blocks until the next batch is ready, nullptr after the last one
+    // also nullptr, right away, while the caller holds all prefetch_batches batches: no buffer is left to read the
+    // next one into, held() tells the two apart
+    std::shared_ptr<SampledBatch const> next();
+    // batches handed out by next() and not released yet
+    int held() const;
+
+    std::size_t batch_bytes() const;
+    // time next() spent waiting for batches, the trainer's stall time
+    double wait_seconds() const;
+    // patches handed out below SamplingPolicy::min_tissue because max_attempts draws found no better one
+    uint64_t low_tissue_count() const { return m_low_tissue; }
+
+private:
+    struct State;
+
+    void _start();
+    void _produce();
+    // the next batch of locations, empty when there are no more, `low_tissue` counts the draws that failed the check
+    std::vector<SampleLocation> _next_locations(std::size_t& low_tissue);
+    // false if the slide cannot be drawn from, `tissue` is set to whether the location passed the tissue check
+    bool _draw(SampleLocation& location, bool& tissue);
+    PatchExtractor const* _extractor(uint32_t slide, double mpp);
+    void _read(SampledBatch& batch);
+
+private:
+    std::vector<DeepZoomGenerator const*> m_slides;
+    PatchSamplerOptions m_options;
+    std::vector<SampleLocation> m_locations;
+    std::size_t m_next = 0;
+    bool m_policy_enabled = false;
+    SamplingPolicy m_policy;
+    std::mt19937 m_rng;
+    std::discrete_distribution<int> m_pick_slide;
+    std::vector<std::unique_ptr<TissueMask>> m_masks; // per slide, policy only
+    std::map<std::pair<uint32_t, double>, std::unique_ptr<PatchExtractor>> m_extractors;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::shared_ptr<State> m_state; // shared with the batches handed out
+    std::atomic<uint64_t> m_low_tissue{0};
+    std::thread m_producer;
+};
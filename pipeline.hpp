@@ -0,0 +1,164 @@
+#pragma once
+
+#include "bounded_queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PipelineStageStats
+{
+    std::string name;
+    int threads = 0;
+    uint64_t items = 0;
+    double busy_seconds = 0.;  // summed over the stage's threads
+    double utilization = 0.;   // busy_seconds / (threads * wall time)
+    uint64_t input_waits = 0;  // times a thread had to wait for input (starved)
+    uint64_t output_waits = 0; // times a thread had to wait for room in the output queue (backpressure)
+};
+
+// linear pipeline of stages connected by bounded lock-free queues, each stage with its own threads
+// items are heap allocated `T`s moved from stage to stage; a stage returning false drops the item
+// a full queue blocks its producers, so the slowest stage sets the pace and memory stays bounded by the
+// queue capacities
+template <typename T>
+class Pipeline
+{
+public:
+    using Stage = std::function<bool(T&)>;
+
+    Pipeline& add_stage(std::string name, int threads, Stage fn)
+    {
+        m_stages.push_back(std::make_unique<StageState>());
+        auto& s = *m_stages.back();
+        s.name = std::move(name);
+        s.threads = std::max(1, threads);
+        s.fn = std::move(fn);
+        return *this;
+    }
+
+    // `source` fills the next item and returns false when there are no more, it runs on the calling thread
+    // returns after every item went through all stages
+    void run(std::function<bool(T&)> const& source, std::size_t queue_capacity = 64)
+    {
+        auto const n = m_stages.size();
+        std::vector<std::unique_ptr<BoundedQueue<std::unique_ptr<T>>>> queues;
+        for (std::size_t i = 0; i < n; i++)
+            queues.push_back(std::make_unique<BoundedQueue<std::unique_ptr<T>>>(queue_capacity));
+        // producers_left[i]: threads still able to push into queues[i], the source counts as one for queue 0
+        std::vector<std::atomic<int>> producers_left(n);
+        producers_left[0] = 1;
+        for (std::size_t i = 1; i < n; i++)
+            producers_left[i] = m_stages[i - 1]->threads;
+
+        auto const start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < n; i++)
+            for (auto t = 0; t < m_stages[i]->threads; t++)
+                threads.emplace_back([&, i]() {
+                    auto& stage = *m_stages[i];
+                    auto* in = queues[i].get();
+                    auto* out = i + 1 < n ? queues[i + 1].get() : nullptr;
+                    std::unique_ptr<T> item;
+                    int idle = 0;
+                    while (true)
+                    {
+                        if (!in->try_pop(item))
+                        {
+                            // drained only once every upstream producer is gone and the queue is still empty
+                            if (producers_left[i].load(std::memory_order_acquire) == 0 && !in->try_pop(item)) break;
+                            if (!item)
+                            {
+                                if (idle == 0) stage.input_waits++;
+                                _backoff(idle++);
+                                continue;
+                            }
+                        }
+                        idle = 0;
+                        auto t0 = std::chrono::steady_clock::now();
+                        auto keep = stage.fn(*item);
+                        stage.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now() - t0)
+                                             .count();
+                        stage.items++;
+                        if (keep && out) _push(*out, item, stage.output_waits);
+                        item.reset();
+                    }
+                    if (out) producers_left[i + 1].fetch_sub(1, std::memory_order_release);
+                });
+
+        while (true)
+        {
+            auto item = std::make_unique<T>();
+            if (!source(*item)) break;
+            _push(*queues[0], item, m_source_waits);
+        }
+        producers_left[0].store(0, std::memory_order_release);
+        for (auto& t : threads)
+            t.join();
+        m_wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::vector<PipelineStageStats> stats() const
+    {
+        std::vector<PipelineStageStats> stats;
+        for (auto const& s : m_stages)
+        {
+            PipelineStageStats st;
+            st.name = s->name;
+            st.threads = s->threads;
+            st.items = s->items;
+            st.busy_seconds = s->busy_ns * 1e-9;
+            st.utilization = m_wall_seconds > 0. ? st.busy_seconds / (s->threads * m_wall_seconds) : 0.;
+            st.input_waits = s->input_waits;
+            st.output_waits = s->output_waits;
+            stats.push_back(st);
+        }
+        return stats;
+    }
+
+    double wall_seconds() const { return m_wall_seconds; }
+    // times the source had to wait for room in the first queue
+    uint64_t source_waits() const { return m_source_waits; }
+
+private:
+    struct StageState
+    {
+        std::string name;
+        int threads = 1;
+        Stage fn;
+        std::atomic<uint64_t> items{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> input_waits{0};
+        std::atomic<uint64_t> output_waits{0};
+    };
+
+    // yield first, then sleep for exponentially longer up to 1ms
+    static void _backoff(int attempt)
+    {
+        if (attempt < 4)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min(1000, 10 << std::min(attempt - 4, 7))));
+    }
+
+    template <typename Counter>
+    static void _push(BoundedQueue<std::unique_ptr<T>>& queue, std::unique_ptr<T>& item, Counter& waits)
+    {
+        for (auto attempt = 0; !queue.try_push(item); attempt++)
+        {
+            if (attempt == 0) waits++;
+            _backoff(attempt);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<StageState>> m_stages;
+    double m_wall_seconds = 0.;
+    uint64_t m_source_waits = 0;
+};
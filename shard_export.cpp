@@ -0,0 +1,194 @@
+#include "shard_export.hpp"
+#include "content_hash.hpp"
+#include "image_codec.hpp"
+#include "tile_pack.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr char kShardMeta[] = "deepzoom-shard";
+
+    std::string _meta(ShardSpec const& shard, std::string const& quickhash)
+    {
+        return std::string(kShardMeta) + " " + std::to_string(shard.index) + " " + std::to_string(shard.count) + " " +
+               quickhash;
+    }
+
+    bool _parse_meta(std::string const& meta, ShardSpec& shard, std::string& quickhash)
+    {
+        std::istringstream in(meta);
+        std::string magic;
+        in >> magic >> shard.index >> shard.count >> quickhash;
+        return in && magic == kShardMeta && shard.count > 0 && shard.index >= 0 && shard.index < shard.count;
+    }
+
+    // first cost of shard `s`, floor(s * total / count) without overflowing
+    int64_t _shard_start(int64_t total, int s, int count)
+    {
+        return s * (total / count) + s * (total % count) / count;
+    }
+} // namespace
+
+int64_t estimated_tile_cost(DeepZoomGenerator const& generator, TileIndex const& tile)
+{
+    auto const col = static_cast<int>(tile.col), row = static_cast<int>(tile.row);
+    auto const [z_width, z_height] = generator.get_tile_dimensions(tile.level, col, row);
+    auto cost = z_width * z_height;
+    if (tile.level >= generator.coarse_level_count())
+    {
+        auto const [l0_location, slide_level, l_size] = generator.get_tile_coordinates(tile.level, col, row);
+        cost += l_size.first * l_size.second;
+    }
+    return cost;
+}
+
+TileRange shard_tiles(DeepZoomGenerator const& generator, ShardSpec const& shard)
+{
+    TileRange range(generator.level_tiles(), TileOrder::Hilbert);
+    if (shard.count <= 0 || shard.index < 0 || shard.index >= shard.count) return {};
+
+    std::vector<int64_t> costs;
+    costs.reserve(static_cast<std::size_t>(range.size()));
+    int64_t total = 0;
+    for (auto const& t : range)
+        total += costs.emplace_back(estimated_tile_cost(generator, t));
+
+    // a tile belongs to the shard its starting cost falls into, so shards are contiguous and one expensive tile
+    // never gets split
+    std::vector<int64_t> sizes(shard.count);
+    int64_t prefix = 0;
+    auto s = 0;
+    for (auto cost : costs)
+    {
+        while (s + 1 < shard.count && prefix >= _shard_start(total, s + 1, shard.count))
+            s++;
+        sizes[s]++;
+        prefix += cost;
+    }
+    return range.split(sizes)[shard.index];
+}
+
+bool write_dzi_shard(DeepZoomGenerator const& generator, std::string const& pack_path, ShardSpec const& shard,
+                     DziOptions const& options, ExportStats* stats)
+{
+    if (shard.count <= 0 || shard.index < 0 || shard.index >= shard.count) return false;
+    auto const range = shard_tiles(generator, shard);
+
+    uint32_t background = 0xffffff;
+    if (auto const* p = generator.source().get_property_value(OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); p)
+        background = static_cast<uint32_t>(std::strtoul(p, nullptr, 16));
+
+    TilePackWriter pack(pack_path, generator.get_dzi("jpeg"), _meta(shard, generator.quickhash()), options.dedup);
+    if (!pack.ok()) return false;
+    auto const total = range.size();
+    std::mutex progress_mutex;
+    int64_t written = 0;
+
+    auto ok = run_export_pipeline(
+        generator, range, options.stages,
+        [&](ExportTile& t) { t.encoded = encode_jpeg(t.pixels, t.width, t.height, options.quality, background); },
+        [&](ExportTile const& t) {
+            if (t.encoded.empty()) return false; // encoding failed
+            if (!pack.add(t.index, t.encoded.data(), t.encoded.size())) return false;
+            if (options.progress)
+            {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                options.progress(++written, total);
+            }
+            return true;
+        },
+        stats, native_jpeg_passthrough(options.native_jpeg));
+    if (stats) stats->dedup = pack.dedup_stats();
+    return pack.finish() && ok;
+}
+
+bool merge_shards(std::vector<std::string> const& pack_paths, std::string const& output, bool dedup,
+                  DedupStats* stats)
+{
+    if (pack_paths.empty()) return false;
+    std::vector<std::unique_ptr<TilePackReader>> packs;
+    std::string quickhash;
+    auto count = 0;
+    for (auto const& path : pack_paths)
+    {
+        auto pack = TilePackReader::open(path);
+        if (!pack) return false;
+        ShardSpec shard;
+        std::string hash;
+        if (!_parse_meta(pack->meta(), shard, hash)) return false;
+        if (packs.empty())
+        {
+            quickhash = hash;
+            count = shard.count;
+            packs.resize(count);
+        }
+        if (shard.count != count || hash != quickhash || packs[shard.index]) return false;
+        packs[shard.index] = std::move(pack);
+    }
+    for (auto const& pack : packs)
+        if (!pack || pack->descriptor() != packs[0]->descriptor()) return false;
+
+    if (fs::path(output).extension() != ".dzi")
+    {
+        TilePackWriter merged(output, packs[0]->descriptor(), _meta({0, 1}, quickhash), dedup);
+        for (auto const& pack : packs)
+        {
+            if (!dedup)
+            {
+                if (!merged.add(*pack)) return false;
+                continue;
+            }
+            for (auto const& e : pack->entries())
+                if (auto const data = pack->read(e); data.size() != e.size || !merged.add(e.index, data.data(), e.size))
+                    return false;
+        }
+        if (stats) *stats = merged.dedup_stats();
+        return merged.finish();
+    }
+
+    auto const dzi = fs::path(output);
+    auto const tiles_dir = dzi.parent_path() / (dzi.stem().string() + "_files");
+    std::error_code ec;
+    std::vector<char> level_created;
+    ContentDedup<fs::path> stored;
+    for (auto const& pack : packs)
+        for (auto const& e : pack->entries())
+        {
+            auto const level_dir = tiles_dir / std::to_string(e.index.level);
+            if (e.index.level >= static_cast<int>(level_created.size())) level_created.resize(e.index.level + 1);
+            if (!level_created[e.index.level])
+            {
+                if (fs::create_directories(level_dir, ec); ec) return false;
+                level_created[e.index.level] = 1;
+            }
+            auto const data = pack->read(e);
+            if (data.size() != e.size) return false;
+            auto const path = level_dir / (std::to_string(e.index.col) + "_" + std::to_string(e.index.row) + ".jpeg");
+            fs::remove(path, ec);
+            auto const hash = dedup ? content_hash(data) : 0;
+            auto first = dedup ? stored.find(hash, e.size) : std::nullopt;
+            if (first && link_tile_file(*first, path))
+            {
+                stored.add_duplicate(e.size);
+                continue;
+            }
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const*>(data.data()), data.size());
+            if (!out) return false;
+            if (dedup) stored.insert(hash, e.size, path);
+        }
+    if (stats) *stats = stored.stats();
+
+    // the descriptor last, so its presence marks a complete export
+    std::ofstream out(dzi, std::ios::trunc);
+    out << packs[0]->descriptor();
+    out.close();
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "deepzoom.hpp"
+#include "dzi_writer.hpp"
+#include "export_pipeline.hpp"
+#include "tile_order.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// shard `index` of `count`, 0 based
+struct ShardSpec
+{
+    int index = 0;
+    int count = 1;
+};
+
+// estimated work to render and encode a tile: the slide pixels read for it plus the pixels encoded, tiles of the
+// coarse levels are cut from memory and only cost the encoding
+int64_t estimated_tile_cost(DeepZoomGenerator const& generator, TileIndex const& tile);
+
+// the tiles of one shard: the Hilbert walk over every level cut into `count` contiguous slices of about equal
+// estimated cost, a shard can come out empty when single tiles cost more than a share
+// depends on the generator geometry only, so every node computes the same partition without coordination
+TileRange shard_tiles(DeepZoomGenerator const& generator, ShardSpec const& shard);
+
+// export the tiles of `shard` as JPEG into the tile pack `pack_path`, the pack carries the DZI and the shard spec
+// for merge_shards
+// returns false on I/O error
+bool write_dzi_shard(DeepZoomGenerator const& generator, std::string const& pack_path, ShardSpec const& shard,
+                     DziOptions const& options = {}, ExportStats* stats = nullptr);
+
+// combine the packs of every shard of one export into a Deep Zoom image if `output` ends with .dzi, else into a
+// single tile pack
+// with `dedup` identical tiles across all shards are stored once, as in DziOptions::dedup, otherwise pack output
+// copies the shards as they are
+// fails if a shard is missing or repeated, or if the shards come from different slides or settings
+bool merge_shards(std::vector<std::string> const& pack_paths, std::string const& output, bool dedup = false,
+                  DedupStats* stats = nullptr);
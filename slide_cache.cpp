@@ -0,0 +1,37 @@
+#include "slide_cache.hpp"
+
+#include <mutex>
+
+namespace
+{
+    std::mutex _shared_mutex;
+    std::shared_ptr<SlideCache> _shared_cache;
+} // namespace
+
+SlideCache::SlideCache(std::size_t capacity_bytes)
+    : m_cache(openslide_cache_create(capacity_bytes)), m_capacity(capacity_bytes)
+{
+}
+
+SlideCache::~SlideCache()
+{
+    if (m_cache) openslide_cache_release(m_cache);
+}
+
+void SlideCache::attach(openslide_t* slide) const
+{
+    if (m_cache && slide) openslide_set_cache(slide, m_cache);
+}
+
+std::shared_ptr<SlideCache> SlideCache::shared()
+{
+    std::lock_guard<std::mutex> lock(_shared_mutex);
+    return _shared_cache;
+}
+
+void SlideCache::set_shared_capacity(std::size_t capacity_bytes)
+{
+    auto cache = capacity_bytes > 0 ? std::make_shared<SlideCache>(capacity_bytes) : nullptr;
+    std::lock_guard<std::mutex> lock(_shared_mutex);
+    _shared_cache = std::move(cache);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <openslide.h>
+
+#include <cstddef>
+#include <memory>
+
+// decoded slide tile cache that can be shared by many openslide handles (openslide >= 4.0)
+// without one every slide keeps its own private cache, so memory grows with the number of open slides; with one the
+// total is bounded by its capacity and hot tiles of busy slides push out cold tiles of idle ones
+class SlideCache
+{
+public:
+    explicit SlideCache(std::size_t capacity_bytes);
+    ~SlideCache();
+
+    SlideCache(SlideCache const&) = delete;
+    SlideCache& operator=(SlideCache const&) = delete;
+
+    std::size_t capacity_bytes() const { return m_capacity; }
+    openslide_cache_t* handle() const { return m_cache; }
+    // openslide holds its own reference, the cache outlives this object while slides still use it
+    void attach(openslide_t* slide) const;
+
+    // the cache open_slide_source attaches new slides to, nullptr (private caches) until set_shared_capacity
+    static std::shared_ptr<SlideCache> shared();
+    // replaces the shared cache, slides opened before keep the previous one; 0 goes back to private caches
+    static void set_shared_capacity(std::size_t capacity_bytes);
+
+private:
+    openslide_cache_t* m_cache = nullptr;
+    std::size_t m_capacity = 0;
+};
@@ -0,0 +1,336 @@
+#include "slide_source.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+int SlideSource::get_best_level_for_downsample(double downsample) const
+{
+    // same rule as openslide: the largest level whose downsample does not exceed the requested one
+    auto levels = get_level_count();
+    if (levels <= 0) return -1;
+    if (downsample < get_level_downsample(0)) return 0;
+    for (auto l = 1; l < levels; l++)
+        if (downsample < get_level_downsample(l)) return l - 1;
+    return levels - 1;
+}
+
+OpenSlideSource::OpenSlideSource(openslide_t* slide, bool owned) : m_slide(slide), m_owned(owned) {}
+
+OpenSlideSource::~OpenSlideSource()
+{
+    if (m_owned && m_slide) openslide_close(m_slide);
+}
+
+int OpenSlideSource::get_level_count() const
+{
+    return openslide_get_level_count(m_slide);
+}
+
+std::pair<int64_t, int64_t> OpenSlideSource::get_level_dimensions(int level) const
+{
+    int64_t w = -1, h = -1;
+    openslide_get_level_dimensions(m_slide, level, &w, &h);
+    return {w, h};
+}
+
+double OpenSlideSource::get_level_downsample(int level) const
+{
+    return openslide_get_level_downsample(m_slide, level);
+}
+
+int OpenSlideSource::get_best_level_for_downsample(double downsample) const
+{
+    return openslide_get_best_level_for_downsample(m_slide, downsample);
+}
+
+char const* OpenSlideSource::get_property_value(char const* name) const
+{
+    return openslide_get_property_value(m_slide, name);
+}
+
+std::vector<std::string> OpenSlideSource::get_property_names() const
+{
+    std::vector<std::string> names;
+    if (auto const* const* p = openslide_get_property_names(m_slide); p)
+        for (; *p; p++)
+            names.emplace_back(*p);
+    return names;
+}
+
+bool OpenSlideSource::read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const
+{
+    openslide_read_region(m_slide, dest, x, y, level, w, h);
+    return openslide_get_error(m_slide) == nullptr;
+}
+
+std::vector<uint8_t> OpenSlideSource::get_icc_profile() const
+{
+    auto const size = openslide_get_icc_profile_size(m_slide);
+    if (size <= 0) return {};
+    std::vector<uint8_t> profile(size);
+    openslide_read_icc_profile(m_slide, profile.data());
+    if (openslide_get_error(m_slide)) return {};
+    return profile;
+}
+
+SyntheticSlideSource::SyntheticSlideSource(Options const& options) : m_options(options)
+{
+    m_options.levels = std::max(1, m_options.levels);
+    m_options.tile_size = std::max(int64_t{1}, m_options.tile_size);
+
+    m_l_dimensions.reserve(m_options.levels);
+    m_level_downsamples.reserve(m_options.levels);
+    for (auto l = 0; l < m_options.levels; l++)
+    {
+        auto d = std::pow(2, l);
+        m_l_dimensions.push_back({std::max(int64_t{1}, static_cast<int64_t>(m_options.width / d)),
+                                  std::max(int64_t{1}, static_cast<int64_t>(m_options.height / d))});
+        m_level_downsamples.push_back(d);
+    }
+
+    m_properties[OPENSLIDE_PROPERTY_NAME_VENDOR] = "synthetic";
+    m_properties[OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR] = "FFFFFF";
+    m_properties[OPENSLIDE_PROPERTY_NAME_MPP_X] = std::to_string(m_options.mpp);
+    m_properties[OPENSLIDE_PROPERTY_NAME_MPP_Y] = std::to_string(m_options.mpp);
+    m_properties[OPENSLIDE_PROPERTY_NAME_QUICKHASH1] =
+        "synthetic-" + std::to_string(m_options.width) + "x" + std::to_string(m_options.height) + "-" +
+        std::to_string(m_options.levels) + "-" + std::to_string(m_options.tile_size) + "-" +
+        std::to_string(m_options.seed);
+    m_properties["openslide.level-count"] = std::to_string(m_options.levels);
+    for (auto l = 0; l < m_options.levels; l++)
+    {
+        auto prefix = "openslide.level[" + std::to_string(l) + "].";
+        m_properties[prefix + "width"] = std::to_string(m_l_dimensions[l].first);
+        m_properties[prefix + "height"] = std::to_string(m_l_dimensions[l].second);
+        m_properties[prefix + "downsample"] = std::to_string(m_level_downsamples[l]);
+        m_properties[prefix + "tile-width"] = std::to_string(m_options.tile_size);
+        m_properties[prefix + "tile-height"] = std::to_string(m_options.tile_size);
+    }
+}
+
+int SyntheticSlideSource::get_level_count() const
+{
+    return m_options.levels;
+}
+
+std::pair<int64_t, int64_t> SyntheticSlideSource::get_level_dimensions(int level) const
+{
+    if (level < 0 || level >= m_options.levels) return {-1, -1};
+    return m_l_dimensions[level];
+}
+
+double SyntheticSlideSource::get_level_downsample(int level) const
+{
+    if (level < 0 || level >= m_options.levels) return -1.;
+    return m_level_downsamples[level];
+}
+
+char const* SyntheticSlideSource::get_property_value(char const* name) const
+{
+    if (auto it = m_properties.find(name); it != m_properties.end()) return it->second.c_str();
+    return nullptr;
+}
+
+std::vector<std::string> SyntheticSlideSource::get_property_names() const
+{
+    std::vector<std::string> names;
+    names.reserve(m_properties.size());
+    for (auto const& [k, v] : m_properties)
+        names.push_back(k);
+    return names;
+}
+
+bool SyntheticSlideSource::read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const
+{
+    if (level < 0 || level >= m_options.levels || w < 0 || h < 0) return false;
+    if (m_options.read_latency.count() > 0) std::this_thread::sleep_for(m_options.read_latency);
+
+    auto const ds = m_level_downsamples[level];
+    auto const& [lw, lh] = m_l_dimensions[level];
+    // (x, y) is the level 0 position of the top left pixel
+    auto const lx = static_cast<int64_t>(std::floor(x / ds));
+    auto const ly = static_cast<int64_t>(std::floor(y / ds));
+    for (int64_t j = 0; j < h; j++)
+    {
+        auto* out = dest + j * w;
+        auto yy = ly + j;
+        if (yy < 0 || yy >= lh)
+        {
+            std::fill(out, out + w, 0u);
+            continue;
+        }
+        auto y0 = static_cast<int64_t>((yy + 0.5) * ds);
+        for (int64_t i = 0; i < w; i++)
+        {
+            auto xx = lx + i;
+            out[i] = (xx < 0 || xx >= lw) ? 0u : _pixel(static_cast<int64_t>((xx + 0.5) * ds), y0);
+        }
+    }
+    return true;
+}
+
+uint32_t SyntheticSlideSource::_pixel(int64_t x, int64_t y) const
+{
+    auto const ts = m_options.tile_size;
+    auto const cx = x / ts, cy = y / ts;
+    // cheap integer hash of the cell, stable across levels and runs
+    uint64_t hash = static_cast<uint64_t>(cx) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(cy) * 0xC2B2AE3D27D4EB4Full ^
+                    (static_cast<uint64_t>(m_options.seed) + 1) * 0x165667B19E3779F9ull;
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+
+    if ((hash & 0xffff) < static_cast<uint64_t>(m_options.background_fraction * 0x10000)) return 0xffffffffu;
+
+    // tissue-like cell: a hashed base color modulated by a radial blob and a fine stripe pattern
+    auto const fx = static_cast<double>(x - cx * ts) / ts - 0.5;
+    auto const fy = static_cast<double>(y - cy * ts) / ts - 0.5;
+    auto const blob = std::max(0., 1. - 2.5 * (fx * fx + fy * fy));
+    auto const stripe = ((x + y) / 8) & 1 ? 0.9 : 1.;
+    auto channel = [&](int shift, int lo) {
+        auto base = lo + static_cast<int>((hash >> shift) & 0x3f);
+        auto v = 255. - (255. - base) * blob * stripe;
+        return static_cast<uint32_t>(std::clamp(v, 0., 255.));
+    };
+    return 0xff000000u | (channel(16, 160) << 16) | (channel(24, 60) << 8) | channel(32, 150);
+}
+
+SlideMetadata slide_metadata(SlideSource const& source)
+{
+    SlideMetadata metadata;
+    for (auto l = 0; l < source.get_level_count(); l++)
+    {
+        metadata.level_dimensions.push_back(source.get_level_dimensions(l));
+        metadata.level_downsamples.push_back(source.get_level_downsample(l));
+    }
+    for (auto const& name : source.get_property_names())
+        if (auto const* value = source.get_property_value(name.c_str()); value) metadata.properties[name] = value;
+    return metadata;
+}
+
+LazySlideSource::LazySlideSource(std::string path, SlideMetadata metadata)
+    : m_path(std::move(path)), m_metadata(std::move(metadata))
+{
+}
+
+int LazySlideSource::get_level_count() const
+{
+    return static_cast<int>(m_metadata.level_dimensions.size());
+}
+
+std::pair<int64_t, int64_t> LazySlideSource::get_level_dimensions(int level) const
+{
+    if (level < 0 || level >= get_level_count()) return {-1, -1};
+    return m_metadata.level_dimensions[level];
+}
+
+double LazySlideSource::get_level_downsample(int level) const
+{
+    if (level < 0 || level >= get_level_count()) return -1.;
+    return m_metadata.level_downsamples[level];
+}
+
+char const* LazySlideSource::get_property_value(char const* name) const
+{
+    auto it = m_metadata.properties.find(name);
+    return it == m_metadata.properties.end() ? nullptr : it->second.c_str();
+}
+
+std::vector<std::string> LazySlideSource::get_property_names() const
+{
+    std::vector<std::string> names;
+    for (auto const& [name, value] : m_metadata.properties)
+        names.push_back(name);
+    return names;
+}
+
+bool LazySlideSource::read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const
+{
+    auto const* slide = _open();
+    if (!slide) return false;
+    return slide->read_region(dest, x, y, level, w, h);
+}
+
+std::vector<uint8_t> LazySlideSource::get_icc_profile() const
+{
+    auto const* slide = _open();
+    return slide ? slide->get_icc_profile() : std::vector<uint8_t>{};
+}
+
+SlideSource const* LazySlideSource::_open() const
+{
+    std::call_once(m_once, [this]() {
+        auto slide = open_slide_source(m_path);
+        // the file at m_path must still be the slide the metadata was taken from
+        if (slide)
+        {
+            auto const* hash = slide->get_property_value(OPENSLIDE_PROPERTY_NAME_QUICKHASH1);
+            auto const* expected = get_property_value(OPENSLIDE_PROPERTY_NAME_QUICKHASH1);
+            if ((hash == nullptr) != (expected == nullptr) || (hash && std::string(hash) != expected) ||
+                slide->get_level_count() != get_level_count() ||
+                slide->get_level_dimensions(0) != get_level_dimensions(0))
+                slide.reset();
+        }
+        m_slide = std::move(slide);
+        m_opened = true;
+    });
+    return m_slide.get();
+}
+
+std::shared_ptr<SlideSource> open_slide_source(std::string const& path)
+{
+    static std::string const prefix = "synthetic:";
+    if (path.compare(0, prefix.size(), prefix) != 0)
+    {
+        auto* slide = openslide_open(path.c_str());
+        if (!slide) return nullptr;
+        if (openslide_get_error(slide))
+        {
+            openslide_close(slide);
+            return nullptr;
+        }
+        auto source = std::make_shared<OpenSlideSource>(slide, true);
+        if (auto cache = SlideCache::shared(); cache) source->set_cache(*cache);
+        return source;
+    }
+
+    SyntheticSlideSource::Options options;
+    auto spec = path.substr(prefix.size());
+    std::size_t pos = 0;
+    while (pos <= spec.size())
+    {
+        auto end = spec.find(',', pos);
+        if (end == std::string::npos) end = spec.size();
+        auto token = spec.substr(pos, end - pos);
+        pos = end + 1;
+        if (token.empty()) continue;
+        if (auto eq = token.find('='); eq != std::string::npos)
+        {
+            auto key = token.substr(0, eq);
+            auto value = std::strtoll(token.c_str() + eq + 1, nullptr, 10);
+            if (key == "levels")
+                options.levels = static_cast<int>(value);
+            else if (key == "tile")
+                options.tile_size = value;
+            else if (key == "latency_us")
+                options.read_latency = std::chrono::microseconds(value);
+            else if (key == "seed")
+                options.seed = static_cast<uint32_t>(value);
+            else
+                return nullptr;
+        }
+        else if (auto x = token.find('x'); x != std::string::npos)
+        {
+            options.width = std::strtoll(token.c_str(), nullptr, 10);
+            options.height = std::strtoll(token.c_str() + x + 1, nullptr, 10);
+        }
+        else
+            return nullptr;
+    }
+    if (options.width <= 0 || options.height <= 0) return nullptr;
+    return std::make_shared<SyntheticSlideSource>(options);
+}
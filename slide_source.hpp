@@ -0,0 +1,150 @@
+#pragma once
+
+#include "slide_cache.hpp"
+
+#include <openslide.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// pixel source behind DeepZoomGenerator, modeled after the openslide C API
+// read_region fills `dest` with w * h premultiplied ARGB pixels, transparent outside the slide
+class SlideSource
+{
+public:
+    virtual ~SlideSource() = default;
+
+    virtual int get_level_count() const = 0;
+    // <width, height>
+    virtual std::pair<int64_t, int64_t> get_level_dimensions(int level) const = 0;
+    virtual double get_level_downsample(int level) const = 0;
+    virtual int get_best_level_for_downsample(double downsample) const;
+    // nullptr if the property does not exist
+    virtual char const* get_property_value(char const* name) const = 0;
+    virtual std::vector<std::string> get_property_names() const = 0;
+    // (x, y) is in level 0 coordinates, returns false on error
+    virtual bool read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const = 0;
+    // ICC profile of the pixels, empty if there is none
+    virtual std::vector<uint8_t> get_icc_profile() const { return {}; }
+};
+
+// wrapper around an opened openslide handle, closes it on destruction only if `owned`
+class OpenSlideSource : public SlideSource
+{
+public:
+    explicit OpenSlideSource(openslide_t* slide, bool owned = false);
+    ~OpenSlideSource() override;
+
+    OpenSlideSource(OpenSlideSource const&) = delete;
+    OpenSlideSource& operator=(OpenSlideSource const&) = delete;
+
+    int get_level_count() const override;
+    std::pair<int64_t, int64_t> get_level_dimensions(int level) const override;
+    double get_level_downsample(int level) const override;
+    int get_best_level_for_downsample(double downsample) const override;
+    char const* get_property_value(char const* name) const override;
+    std::vector<std::string> get_property_names() const override;
+    bool read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const override;
+    std::vector<uint8_t> get_icc_profile() const override;
+
+    openslide_t* handle() const { return m_slide; }
+    // share decoded tiles with the other slides attached to `cache` instead of the private per-slide cache
+    void set_cache(SlideCache const& cache) { cache.attach(m_slide); }
+
+private:
+    openslide_t* m_slide = nullptr;
+    bool m_owned = false;
+};
+
+// deterministic procedural pyramid for benchmarks and tests without slide files
+// every pixel is a pure function of its level 0 coordinate, so all levels agree with each other
+class SyntheticSlideSource : public SlideSource
+{
+public:
+    struct Options
+    {
+        int64_t width = 100000;
+        int64_t height = 80000;
+        int levels = 4;                         // each level halves the previous one
+        int64_t tile_size = 256;                // size of the procedural pattern cells, reported as native tile size
+        double mpp = 0.25;                      // microns per pixel at level 0
+        double background_fraction = 0.3;       // fraction of cells left as white background
+        uint32_t seed = 0;                      // changes the pattern
+        std::chrono::microseconds read_latency{0}; // artificial latency added to every read_region call
+    };
+
+    explicit SyntheticSlideSource(Options const& options);
+
+    int get_level_count() const override;
+    std::pair<int64_t, int64_t> get_level_dimensions(int level) const override;
+    double get_level_downsample(int level) const override;
+    char const* get_property_value(char const* name) const override;
+    std::vector<std::string> get_property_names() const override;
+    bool read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const override;
+
+    Options const& options() const { return m_options; }
+
+private:
+    uint32_t _pixel(int64_t x, int64_t y) const;
+
+private:
+    Options m_options;
+    std::vector<std::pair<int64_t, int64_t>> m_l_dimensions;
+    std::vector<double> m_level_downsamples;
+    std::map<std::string, std::string> m_properties;
+};
+
+// everything a source answers without reading pixels
+struct SlideMetadata
+{
+    std::vector<std::pair<int64_t, int64_t>> level_dimensions;
+    std::vector<double> level_downsamples;
+    std::map<std::string, std::string> properties;
+};
+
+SlideMetadata slide_metadata(SlideSource const& source);
+
+// source answering metadata queries from a stored SlideMetadata, the slide itself is opened with open_slide_source on
+// the first read_region
+// reads fail if the slide cannot be opened or its openslide.quickhash-1, level count or level 0 dimensions differ from
+// the stored ones
+class LazySlideSource : public SlideSource
+{
+public:
+    LazySlideSource(std::string path, SlideMetadata metadata);
+
+    int get_level_count() const override;
+    std::pair<int64_t, int64_t> get_level_dimensions(int level) const override;
+    double get_level_downsample(int level) const override;
+    char const* get_property_value(char const* name) const override;
+    std::vector<std::string> get_property_names() const override;
+    bool read_region(uint32_t* dest, int64_t x, int64_t y, int level, int64_t w, int64_t h) const override;
+    // opens the slide
+    std::vector<uint8_t> get_icc_profile() const override;
+
+    std::string const& path() const { return m_path; }
+    // true once the slide was opened, whether or not that succeeded
+    bool opened() const { return m_opened; }
+
+private:
+    SlideSource const* _open() const;
+
+private:
+    std::string m_path;
+    SlideMetadata m_metadata;
+    mutable std::once_flag m_once;
+    mutable std::atomic<bool> m_opened{false};
+    mutable std::shared_ptr<SlideSource> m_slide; // nullptr until opened, or if opening failed
+};
+
+// open `path` with openslide, or build a synthetic slide from a spec of the form
+// "synthetic:<width>x<height>[,levels=<n>][,tile=<n>][,latency_us=<n>][,seed=<n>]"
+// the returned source owns the openslide handle and uses SlideCache::shared() if set, nullptr on error
+std::shared_ptr<SlideSource> open_slide_source(std::string const& path);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed size FIFO thread pool, the destructor finishes the queued work before joining
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = 0)
+    {
+        auto n = threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        m_workers.reserve(n);
+        for (auto i = 0; i < n; i++)
+            m_workers.emplace_back([this]() { _run(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto& w : m_workers)
+            w.join();
+    }
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.emplace([task]() { (*task)(); });
+        }
+        m_cv.notify_one();
+        return future;
+    }
+
+    int size() const { return static_cast<int>(m_workers.size()); }
+
+    std::size_t queued() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size();
+    }
+
+private:
+    void _run()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+                job = std::move(m_queue.front());
+                m_queue.pop();
+            }
+            job();
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::queue<std::function<void()>> m_queue;
+    std::vector<std::thread> m_workers;
+    bool m_stop = false;
+};
@@ -0,0 +1,184 @@
+#include "tiered_tile_cache.hpp"
+#include "image_codec.hpp"
+
+#include <cstring>
+#if defined(DEEPZOOM_HAVE_LZ4)
+#include <lz4.h>
+#elif defined(DEEPZOOM_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace
+{
+    // first byte of a cold tier payload
+    enum Codec : uint8_t
+    {
+        kRaw,
+        kLz4,
+        kDeflate,
+        kJpeg
+    };
+
+    bool _opaque(std::vector<uint8_t> const& bgra)
+    {
+        for (std::size_t i = 3; i < bgra.size(); i += 4)
+            if (bgra[i] != 255) return false;
+        return true;
+    }
+
+    std::vector<uint8_t> _compress_lossless(std::vector<uint8_t> const& raw)
+    {
+        std::vector<uint8_t> out;
+#if defined(DEEPZOOM_HAVE_LZ4)
+        out.resize(1 + LZ4_compressBound(static_cast<int>(raw.size())));
+        auto const n = LZ4_compress_default(reinterpret_cast<char const*>(raw.data()),
+                                            reinterpret_cast<char*>(out.data() + 1), static_cast<int>(raw.size()),
+                                            static_cast<int>(out.size() - 1));
+        if (n > 0)
+        {
+            out[0] = kLz4;
+            out.resize(1 + n);
+            return out;
+        }
+#elif defined(DEEPZOOM_HAVE_ZLIB)
+        auto bound = compressBound(static_cast<uLong>(raw.size()));
+        out.resize(1 + bound);
+        // fastest level, the cold tier is about capacity, not the best ratio
+        if (compress2(out.data() + 1, &bound, raw.data(), static_cast<uLong>(raw.size()), 1) == Z_OK)
+        {
+            out[0] = kDeflate;
+            out.resize(1 + bound);
+            return out;
+        }
+#endif
+        out.assign(1, kRaw);
+        out.insert(out.end(), raw.begin(), raw.end());
+        return out;
+    }
+
+    // the pixels of a cold tier tile, empty if the payload is corrupt
+    std::vector<uint8_t> _decompress(Tile const& cold)
+    {
+        auto const& in = cold.data;
+        auto const size = static_cast<std::size_t>(cold.width) * cold.height * 4;
+        if (in.empty()) return {};
+        std::vector<uint8_t> raw;
+        switch (in[0])
+        {
+        case kRaw:
+            raw.assign(in.begin() + 1, in.end());
+            break;
+#if defined(DEEPZOOM_HAVE_LZ4)
+        case kLz4:
+            raw.resize(size);
+            if (LZ4_decompress_safe(reinterpret_cast<char const*>(in.data() + 1), reinterpret_cast<char*>(raw.data()),
+                                    static_cast<int>(in.size() - 1), static_cast<int>(size)) !=
+                static_cast<int>(size))
+                return {};
+            break;
+#elif defined(DEEPZOOM_HAVE_ZLIB)
+        case kDeflate:
+        {
+            raw.resize(size);
+            auto n = static_cast<uLongf>(size);
+            if (uncompress(raw.data(), &n, in.data() + 1, static_cast<uLong>(in.size() - 1)) != Z_OK || n != size)
+                return {};
+            break;
+        }
+#endif
+        case kJpeg:
+            // a corrupt JPEG decodes to nothing and fails the size check, the tile is a miss
+            raw = std::get<2>(decode_jpeg(in.data() + 1, in.size() - 1));
+            break;
+        default:
+            return {};
+        }
+        if (raw.size() != size) return {};
+        return raw;
+    }
+} // namespace
+
+TieredTileCache::TieredTileCache(TileCacheTiers const& tiers)
+    : m_tiers(tiers), m_hot(tiers.hot_bytes), m_cold(tiers.cold_bytes)
+{
+}
+
+TilePtr TieredTileCache::get(TileIndex const& index, bool* cold_hit)
+{
+    if (cold_hit) *cold_hit = false;
+    if (auto tile = m_hot.get(index); tile)
+    {
+        m_hot_hits++;
+        return tile;
+    }
+    if (m_tiers.cold_bytes > 0)
+        if (auto cold = m_cold.get(index); cold)
+            if (auto raw = _decompress(*cold); !raw.empty())
+            {
+                m_cold_hits++;
+                if (cold_hit) *cold_hit = true;
+                auto tile = std::make_shared<Tile const>(Tile{cold->width, cold->height, std::move(raw)});
+                _put_hot(index, tile);
+                return tile;
+            }
+    m_misses++;
+    return nullptr;
+}
+
+TilePtr TieredTileCache::peek(TileIndex const& index) const
+{
+    if (auto tile = m_hot.peek(index); tile) return tile;
+    if (m_tiers.cold_bytes > 0)
+        if (auto cold = m_cold.peek(index); cold)
+            if (auto raw = _decompress(*cold); !raw.empty())
+                return std::make_shared<Tile const>(Tile{cold->width, cold->height, std::move(raw)});
+    return nullptr;
+}
+
+void TieredTileCache::put(TileIndex const& index, TilePtr tile)
+{
+    if (!tile) return;
+    // a compressed copy of what the tile replaces must not come back on demotion
+    m_cold.erase(index);
+    _put_hot(index, std::move(tile));
+}
+
+void TieredTileCache::_put_hot(TileIndex const& index, TilePtr tile)
+{
+    std::vector<std::pair<TileIndex, TilePtr>> evicted;
+    m_hot.put(index, std::move(tile), m_tiers.cold_bytes > 0 ? &evicted : nullptr);
+    // compressed outside the hot tier's lock
+    for (auto const& [i, t] : evicted)
+        _demote(i, t);
+}
+
+void TieredTileCache::clear()
+{
+    m_hot.clear();
+    m_cold.clear();
+}
+
+double TieredTileCache::compression_ratio() const
+{
+    auto const compressed = m_demoted_bytes.load();
+    return compressed > 0 ? static_cast<double>(m_demoted_raw_bytes) / compressed : 1.;
+}
+
+void TieredTileCache::_demote(TileIndex const& index, TilePtr const& tile)
+{
+    // still there from an earlier demotion, the tile came back through a cold hit
+    if (m_cold.peek(index)) return;
+
+    std::vector<uint8_t> payload;
+    if (m_tiers.compression == TileCompression::Jpeg && _opaque(tile->data))
+        if (auto jpeg = encode_jpeg(tile->data, tile->width, tile->height, m_tiers.jpeg_quality); !jpeg.empty())
+        {
+            payload.assign(1, kJpeg);
+            payload.insert(payload.end(), jpeg.begin(), jpeg.end());
+        }
+    if (payload.empty()) payload = _compress_lossless(tile->data);
+
+    m_demoted_raw_bytes += tile->data.size();
+    m_demoted_bytes += payload.size();
+    m_cold.put(index, std::make_shared<Tile const>(Tile{tile->width, tile->height, std::move(payload)}));
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "tile_cache.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+// how the cold tier stores tiles
+enum class TileCompression
+{
+    // exact, LZ4 (DEEPZOOM_HAVE_LZ4) or deflate (DEEPZOOM_HAVE_ZLIB), stored uncompressed without either
+    Lossless,
+    // JPEG at `jpeg_quality`, tiles with transparent pixels fall back to Lossless
+    Jpeg
+};
+
+struct TileCacheTiers
+{
+    std::size_t hot_bytes = std::size_t{512} << 20;
+    std::size_t cold_bytes = 0; // 0 disables the cold tier
+    TileCompression compression = TileCompression::Lossless;
+    int jpeg_quality = 90;
+};
+
+// two tier LRU cache of rendered tiles: a hot tier of raw pixels and a cold tier of compressed tiles
+// tiles evicted from the hot tier are compressed into the cold tier, a cold hit is decompressed and moves back into
+// the hot tier, so a given amount of memory holds many more tiles at the price of a decompression on a cold hit
+// a tile stays in the cold tier while it is hot, so it is compressed only once however often it moves between tiers
+// thread safe
+class TieredTileCache
+{
+public:
+    explicit TieredTileCache(TileCacheTiers const& tiers);
+
+    // nullptr on miss, `cold_hit` if given is set to whether the tile came from the cold tier
+    TilePtr get(TileIndex const& index, bool* cold_hit = nullptr);
+    // nullptr on miss, does not count as an access and does not promote
+    TilePtr peek(TileIndex const& index) const;
+    void put(TileIndex const& index, TilePtr tile);
+    void clear();
+
+    TileCacheTiers const& tiers() const { return m_tiers; }
+    // both tiers, the cold one counts compressed bytes
+    std::size_t capacity_bytes() const { return m_tiers.hot_bytes + m_tiers.cold_bytes; }
+    std::size_t size_bytes() const { return m_hot.size_bytes() + m_cold.size_bytes(); }
+    TileCache const& hot() const { return m_hot; }
+    TileCache const& cold() const { return m_cold; }
+
+    uint64_t hits() const { return m_hot_hits + m_cold_hits; }
+    uint64_t hot_hits() const { return m_hot_hits; }
+    uint64_t cold_hits() const { return m_cold_hits; }
+    uint64_t misses() const { return m_misses; }
+    // raw bytes per compressed byte over every tile demoted so far
+    double compression_ratio() const;
+
+private:
+    void _put_hot(TileIndex const& index, TilePtr tile);
+    void _demote(TileIndex const& index, TilePtr const& tile);
+
+private:
+    TileCacheTiers m_tiers;
+    TileCache m_hot;
+    TileCache m_cold; // Tile::data holds the compressed payload
+    std::atomic<uint64_t> m_hot_hits{0};
+    std::atomic<uint64_t> m_cold_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_demoted_raw_bytes{0};
+    std::atomic<uint64_t> m_demoted_bytes{0};
+};
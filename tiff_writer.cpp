@@ -0,0 +1,236 @@
+#include "tiff_writer.hpp"
+#include "deepzoom.hpp"
+#include "image_codec.hpp"
+#include "image_ops.hpp"
+#include "tile_order.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // https://www.awaresystems.be/imaging/tiff/bigtiff.html
+    enum TiffType : uint16_t
+    {
+        SHORT = 3,
+        LONG = 4,
+        RATIONAL = 5,
+        LONG8 = 16,
+    };
+
+    struct TiffEntry
+    {
+        uint16_t tag;
+        uint16_t type;
+        uint64_t count;
+        std::vector<uint8_t> data; // little endian values, stored inline when they fit into 8 bytes
+    };
+
+    template <typename T>
+    void _put(std::vector<uint8_t>& out, T v)
+    {
+        for (size_t i = 0; i < sizeof(T); i++)
+            out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(v) >> (8 * i)));
+    }
+
+    TiffEntry _shorts(uint16_t tag, std::vector<uint16_t> const& v)
+    {
+        TiffEntry e{tag, SHORT, v.size(), {}};
+        for (auto x : v)
+            _put(e.data, x);
+        return e;
+    }
+
+    TiffEntry _long(uint16_t tag, uint32_t v)
+    {
+        TiffEntry e{tag, LONG, 1, {}};
+        _put(e.data, v);
+        return e;
+    }
+
+    TiffEntry _longs8(uint16_t tag, std::vector<uint64_t> const& v)
+    {
+        TiffEntry e{tag, LONG8, v.size(), {}};
+        for (auto x : v)
+            _put(e.data, x);
+        return e;
+    }
+
+    TiffEntry _rational(uint16_t tag, uint32_t num, uint32_t den)
+    {
+        TiffEntry e{tag, RATIONAL, 1, {}};
+        _put(e.data, num);
+        _put(e.data, den);
+        return e;
+    }
+
+    struct Level
+    {
+        int dz_level;
+        int64_t width, height;
+        int64_t cols, rows;
+        std::vector<uint64_t> offsets;
+        std::vector<uint64_t> byte_counts;
+    };
+} // namespace
+
+bool write_pyramidal_tiff(std::shared_ptr<SlideSource> source, std::string const& path,
+                          PyramidTiffOptions const& options, ExportStats* stats)
+{
+    auto const ts = options.tile_size;
+    if (!source || ts <= 0 || ts % 16 != 0) return false;
+
+    DeepZoomGenerator generator(source, ts, 0, options.limit_bounds);
+    auto const dimensions = generator.level_dimensions();
+    auto const tiles = generator.level_tiles();
+
+    // full resolution first, stop at the first level that fits into one tile
+    std::vector<Level> levels;
+    int64_t total = 0;
+    for (auto l = generator.level_count() - 1; l >= 0; l--)
+    {
+        levels.push_back({l, dimensions[l].first, dimensions[l].second, tiles[l].first, tiles[l].second, {}, {}});
+        levels.back().offsets.resize(tiles[l].first * tiles[l].second);
+        levels.back().byte_counts.resize(tiles[l].first * tiles[l].second);
+        total += tiles[l].first * tiles[l].second;
+        if (tiles[l].first == 1 && tiles[l].second == 1) break;
+    }
+
+    uint32_t background = 0xffffff;
+    if (auto const* p = source->get_property_value(OPENSLIDE_PROPERTY_NAME_BACKGROUND_COLOR); p)
+        background = static_cast<uint32_t>(std::strtoul(p, nullptr, 16));
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    // header, the first IFD offset is patched at the end
+    std::vector<uint8_t> header{'I', 'I'};
+    _put<uint16_t>(header, 43);
+    _put<uint16_t>(header, 8);
+    _put<uint16_t>(header, 0);
+    _put<uint64_t>(header, 0);
+    out.write(reinterpret_cast<char const*>(header.data()), header.size());
+    uint64_t file_pos = header.size();
+
+    std::mutex write_mutex;
+    int64_t written = 0;
+    auto stages = options.stages;
+    if (stages.write_threads <= 0) stages.write_threads = 1;
+    auto const top = generator.level_count() - 1;
+
+    auto ok = run_export_pipeline(
+        generator, TileRange(tiles, TileOrder::Hilbert, levels.back().dz_level, top), stages,
+        [&](ExportTile& t) {
+            // TIFF tiles always have the full tile size, edge tiles are padded
+            if (t.width != ts || t.height != ts)
+            {
+                std::vector<uint8_t> canvas(static_cast<size_t>(ts) * ts * 4, 0);
+                blit_bgra(t.pixels, t.width, t.height, canvas, ts, ts, 0, 0);
+                t.pixels.swap(canvas);
+            }
+            t.encoded = encode_jpeg(t.pixels, ts, ts, options.quality, background);
+        },
+        [&](ExportTile const& t) {
+            if (t.encoded.empty()) return false; // encoding failed
+            auto& level = levels[top - t.index.level];
+            std::lock_guard<std::mutex> lock(write_mutex);
+            auto index = t.index.row * level.cols + t.index.col;
+            level.offsets[index] = file_pos;
+            level.byte_counts[index] = t.encoded.size();
+            out.write(reinterpret_cast<char const*>(t.encoded.data()), t.encoded.size());
+            file_pos += t.encoded.size();
+            if (!out) return false;
+            if (options.progress) options.progress(++written, total);
+            return true;
+        },
+        stats);
+    if (!ok) return false;
+
+    // IFDs, one per level, chained in order
+    float mpp = 0.f;
+    if (auto const* x = source->get_property_value(OPENSLIDE_PROPERTY_NAME_MPP_X); x)
+        if (auto const* y = source->get_property_value(OPENSLIDE_PROPERTY_NAME_MPP_Y); y)
+            mpp = (std::strtof(x, nullptr) + std::strtof(y, nullptr)) / 2.f;
+
+    uint64_t first_ifd = 0;
+    uint64_t prev_next_pos = 0; // file position of the previous IFD's next-IFD field
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        auto const& level = levels[i];
+        std::vector<TiffEntry> entries;
+        entries.push_back(_long(254, i == 0 ? 0 : 1)); // NewSubfileType: reduced resolution image
+        entries.push_back(_long(256, static_cast<uint32_t>(level.width)));
+        entries.push_back(_long(257, static_cast<uint32_t>(level.height)));
+        entries.push_back(_shorts(258, {8, 8, 8}));
+        entries.push_back(_shorts(259, {7})); // JPEG
+        entries.push_back(_shorts(262, {6})); // YCbCr
+        entries.push_back(_shorts(277, {3}));
+        if (mpp > 0.f)
+        {
+            // pixels per centimeter
+            auto ppcm = static_cast<uint32_t>(std::lround(1e7 / (mpp * std::pow(2., static_cast<double>(i)))));
+            entries.push_back(_rational(282, ppcm, 1000));
+            entries.push_back(_rational(283, ppcm, 1000));
+        }
+        entries.push_back(_shorts(284, {1}));
+        if (mpp > 0.f) entries.push_back(_shorts(296, {3})); // centimeter
+        entries.push_back(_long(322, ts));
+        entries.push_back(_long(323, ts));
+        entries.push_back(_longs8(324, level.offsets));
+        entries.push_back(_longs8(325, level.byte_counts));
+        entries.push_back(_shorts(530, {2, 2}));
+
+        // out of line values first, then the IFD itself
+        std::vector<uint8_t> block;
+        std::vector<uint64_t> value_pos(entries.size(), 0);
+        for (size_t e = 0; e < entries.size(); e++)
+            if (entries[e].data.size() > 8)
+            {
+                value_pos[e] = file_pos + block.size();
+                block.insert(block.end(), entries[e].data.begin(), entries[e].data.end());
+            }
+        if (block.size() % 2) block.push_back(0); // IFDs start on a word boundary
+        auto ifd_pos = file_pos + block.size();
+        _put<uint64_t>(block, entries.size());
+        for (size_t e = 0; e < entries.size(); e++)
+        {
+            _put(block, entries[e].tag);
+            _put(block, entries[e].type);
+            _put(block, entries[e].count);
+            if (entries[e].data.size() > 8)
+                _put(block, value_pos[e]);
+            else
+            {
+                auto inline_value = entries[e].data;
+                inline_value.resize(8, 0);
+                block.insert(block.end(), inline_value.begin(), inline_value.end());
+            }
+        }
+        auto next_pos = file_pos + block.size();
+        _put<uint64_t>(block, 0);
+        out.write(reinterpret_cast<char const*>(block.data()), block.size());
+        file_pos += block.size();
+
+        if (i == 0)
+            first_ifd = ifd_pos;
+        else
+        {
+            // link the previous IFD to this one
+            std::vector<uint8_t> link;
+            _put(link, ifd_pos);
+            out.seekp(static_cast<std::streamoff>(prev_next_pos));
+            out.write(reinterpret_cast<char const*>(link.data()), link.size());
+            out.seekp(static_cast<std::streamoff>(file_pos));
+        }
+        prev_next_pos = next_pos;
+    }
+
+    std::vector<uint8_t> link;
+    _put(link, first_ifd);
+    out.seekp(8);
+    out.write(reinterpret_cast<char const*>(link.data()), link.size());
+    out.close();
+    return static_cast<bool>(out);
+}
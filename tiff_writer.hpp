@@ -0,0 +1,28 @@
+#pragma once
+
+#include "export_pipeline.hpp"
+#include "slide_source.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct PyramidTiffOptions
+{
+    int tile_size = 256;       // TIFF tile width and height, must be a multiple of 16
+    int quality = 90;          // JPEG quality
+    bool limit_bounds = false; // convert only the non-empty slide region
+    ExportStages stages;       // the file is appended to by one write thread unless set otherwise
+    // called after every written tile with <tiles written, total tiles>
+    std::function<void(int64_t, int64_t)> progress;
+};
+
+// convert a slide into a tiled, pyramidal BigTIFF with JPEG (YCbCr 4:2:0) compressed tiles
+// the levels are the deepzoom levels from full resolution down to the first one that fits into a single tile, one
+// IFD each, which generic TIFF readers (and openslide's generic-tiff driver) open as a pyramid
+// tiles go through the staged export pipeline and are appended to the file as soon as they are encoded, so memory use
+// is bounded by the pipeline queues and does not depend on the slide size
+// returns false on I/O error or invalid options
+bool write_pyramidal_tiff(std::shared_ptr<SlideSource> source, std::string const& path,
+                          PyramidTiffOptions const& options = {}, ExportStats* stats = nullptr);
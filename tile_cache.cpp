@@ -0,0 +1,96 @@
+#include "tile_cache.hpp"
+
+TileCache::TileCache(std::size_t capacity_bytes) : m_capacity(capacity_bytes) {}
+
+TilePtr TileCache::get(TileIndex const& index)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_map.find(index);
+    if (it == m_map.end())
+    {
+        m_misses++;
+        return nullptr;
+    }
+    m_hits++;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return it->second->second;
+}
+
+TilePtr TileCache::peek(TileIndex const& index) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_map.find(index);
+    return it == m_map.end() ? nullptr : it->second->second;
+}
+
+void TileCache::put(TileIndex const& index, TilePtr tile, std::vector<std::pair<TileIndex, TilePtr>>* evicted)
+{
+    if (!tile) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_map.find(index); it != m_map.end())
+    {
+        m_bytes -= it->second->second->data.size();
+        m_lru.erase(it->second);
+        m_map.erase(it);
+    }
+    m_bytes += tile->data.size();
+    m_lru.emplace_front(index, std::move(tile));
+    m_map[index] = m_lru.begin();
+    _evict(evicted);
+}
+
+void TileCache::erase(TileIndex const& index)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto it = m_map.find(index); it != m_map.end())
+    {
+        m_bytes -= it->second->second->data.size();
+        m_lru.erase(it->second);
+        m_map.erase(it);
+    }
+}
+
+void TileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lru.clear();
+    m_map.clear();
+    m_bytes = 0;
+}
+
+std::size_t TileCache::size_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+std::size_t TileCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_map.size();
+}
+
+uint64_t TileCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+uint64_t TileCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+void TileCache::_evict(std::vector<std::pair<TileIndex, TilePtr>>* evicted)
+{
+    // keep at least the newest entry, even if it alone exceeds the capacity
+    while (m_bytes > m_capacity && m_lru.size() > 1)
+    {
+        auto& [index, tile] = m_lru.back();
+        m_bytes -= tile->data.size();
+        m_map.erase(index);
+        if (evicted) evicted->emplace_back(index, std::move(tile));
+        m_lru.pop_back();
+    }
+}
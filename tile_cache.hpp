@@ -0,0 +1,66 @@
+#pragma once
+
+#include "tile_order.hpp"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// a rendered tile as returned by DeepZoomGenerator::get_tile, shared between the cache and its readers
+struct Tile
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> data; // ARGB_Premultiplied_bytes
+};
+using TilePtr = std::shared_ptr<Tile const>;
+
+struct TileIndexHash
+{
+    std::size_t operator()(TileIndex const& t) const
+    {
+        auto h = static_cast<uint64_t>(t.level) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint64_t>(t.col) + 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+        h ^= static_cast<uint64_t>(t.row) + 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+        return static_cast<std::size_t>(h);
+    }
+};
+
+// thread safe LRU cache of rendered tiles, bounded by the total pixel bytes
+class TileCache
+{
+public:
+    explicit TileCache(std::size_t capacity_bytes);
+
+    // nullptr on miss
+    TilePtr get(TileIndex const& index);
+    // nullptr on miss, does not count as an access
+    TilePtr peek(TileIndex const& index) const;
+    // the entries evicted to make room are appended to `evicted` if given
+    void put(TileIndex const& index, TilePtr tile, std::vector<std::pair<TileIndex, TilePtr>>* evicted = nullptr);
+    void erase(TileIndex const& index);
+    void clear();
+
+    std::size_t capacity_bytes() const { return m_capacity; }
+    std::size_t size_bytes() const;
+    std::size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    void _evict(std::vector<std::pair<TileIndex, TilePtr>>* evicted);
+
+private:
+    using Entry = std::pair<TileIndex, TilePtr>;
+
+    mutable std::mutex m_mutex;
+    std::size_t m_capacity = 0;
+    std::size_t m_bytes = 0;
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    std::list<Entry> m_lru; // most recently used first
+    std::unordered_map<TileIndex, std::list<Entry>::iterator, TileIndexHash> m_map;
+};
@@ -0,0 +1,119 @@
+#include "tile_manifest.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+
+TileManifest::TileManifest(std::string path, int checkpoint_tiles)
+    : m_path(std::move(path)), m_checkpoint_tiles(std::max(1, checkpoint_tiles))
+{
+    std::ifstream in(m_path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, 2, "# ") == 0)
+        {
+            m_header = line.substr(2);
+            continue;
+        }
+        std::istringstream fields(line);
+        TileIndex index;
+        TileManifestEntry entry;
+        std::string end;
+        fields >> index.level >> index.col >> index.row >> entry.size >> std::hex >> entry.hash;
+        // a torn line has fewer fields, or stops in the middle of the hash and fails the check on resume
+        if (fields && !(fields >> end)) m_entries[index] = entry;
+    }
+}
+
+TileManifest::~TileManifest()
+{
+    flush();
+}
+
+std::optional<TileManifestEntry> TileManifest::find(TileIndex const& index) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(index);
+    if (it == m_entries.end()) return std::nullopt;
+    return it->second;
+}
+
+std::size_t TileManifest::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+std::string TileManifest::header() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_header;
+}
+
+bool TileManifest::record(TileIndex const& index, TileManifestEntry const& entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file.is_open() && !_open(std::ios::app)) return false;
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(entry.hash));
+    m_file << index.level << ' ' << index.col << ' ' << index.row << ' ' << entry.size << ' ' << hash << '\n';
+    m_entries[index] = entry;
+    if (++m_pending >= m_checkpoint_tiles)
+    {
+        m_pending = 0;
+        m_file.flush();
+    }
+    return static_cast<bool>(m_file);
+}
+
+bool TileManifest::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending = 0;
+    if (!m_file.is_open()) return true;
+    m_file.flush();
+    return static_cast<bool>(m_file);
+}
+
+bool TileManifest::clear(std::string header)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_pending = 0;
+    m_header = std::move(header);
+    if (!_open(std::ios::trunc)) return false;
+    if (!m_header.empty()) m_file << "# " << m_header << '\n' << std::flush;
+    return static_cast<bool>(m_file);
+}
+
+bool TileManifest::compact()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto const tmp = m_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!m_header.empty()) out << "# " << m_header << '\n';
+        char hash[17];
+        for (auto const& [index, entry] : m_entries)
+        {
+            std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(entry.hash));
+            out << index.level << ' ' << index.col << ' ' << index.row << ' ' << entry.size << ' ' << hash << '\n';
+        }
+        if (!out.flush()) return false;
+    }
+    m_file.close();
+    m_pending = 0;
+    std::error_code ec;
+    std::filesystem::rename(tmp, m_path, ec);
+    return !ec;
+}
+
+bool TileManifest::_open(std::ios::openmode mode)
+{
+    m_file.close();
+    m_file.clear();
+    m_file.open(m_path, std::ios::out | mode);
+    return static_cast<bool>(m_file);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "tile_cache.hpp"
+#include "tile_order.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct TileManifestEntry
+{
+    uint64_t size = 0; // bytes
+    uint64_t hash = 0; // content_hash of the bytes
+};
+
+// the tiles an export has completely written, with the size and content hash of each
+// kept as an append-only text log, one "<level> <col> <row> <size> <hash>" line per tile, flushed every
+// `checkpoint_tiles` records, so an interrupted export loses at most that much progress
+// the first line, "# <header>", describes the slide and settings the tiles were written with
+class TileManifest
+{
+public:
+    // loads `path` if it exists, malformed lines (the torn last line of an interrupted run) are ignored
+    explicit TileManifest(std::string path, int checkpoint_tiles = 256);
+    ~TileManifest();
+
+    TileManifest(TileManifest const&) = delete;
+    TileManifest& operator=(TileManifest const&) = delete;
+
+    std::optional<TileManifestEntry> find(TileIndex const& index) const;
+    std::size_t size() const;
+    // as loaded or passed to clear, empty if the file has none
+    std::string header() const;
+    // call once the tile is completely written, thread safe
+    bool record(TileIndex const& index, TileManifestEntry const& entry);
+    bool flush();
+    // forgets every tile and truncates the file to the line holding `header`
+    bool clear(std::string header = {});
+    // rewrites the file with one line per tile, dropping records superseded by a later run
+    bool compact();
+
+private:
+    bool _open(std::ios::openmode mode);
+
+private:
+    mutable std::mutex m_mutex;
+    std::string m_path;
+    std::string m_header; // one line
+    int m_checkpoint_tiles = 256;
+    int m_pending = 0; // records since the last flush
+    std::ofstream m_file;
+    std::unordered_map<TileIndex, TileManifestEntry, TileIndexHash> m_entries;
+};
@@ -0,0 +1,255 @@
+#include "tile_order.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    uint64_t _compact_bits(uint64_t v)
+    {
+        v &= 0x5555555555555555ull;
+        v = (v | (v >> 1)) & 0x3333333333333333ull;
+        v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+        v = (v | (v >> 16)) & 0x00000000ffffffffull;
+        return v;
+    }
+
+    // https://en.wikipedia.org/wiki/Hilbert_curve
+    std::pair<uint64_t, uint64_t> _hilbert_d2xy(uint64_t n, uint64_t d)
+    {
+        uint64_t x = 0, y = 0;
+        for (uint64_t s = 1; s < n; s *= 2)
+        {
+            auto rx = 1 & (d / 2);
+            auto ry = 1 & (d ^ rx);
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+            x += s * rx;
+            y += s * ry;
+            d /= 4;
+        }
+        return {x, y};
+    }
+} // namespace
+
+LevelTileRange::LevelTileRange(int level, std::pair<int64_t, int64_t> tiles, TileOrder order)
+    : m_level(level), m_cols(std::max(int64_t{0}, tiles.first)), m_rows(std::max(int64_t{0}, tiles.second)),
+      m_order(order)
+{
+    m_count = m_cols * m_rows;
+    if (m_order == TileOrder::RowMajor)
+        m_d_end = static_cast<uint64_t>(m_count);
+    else
+    {
+        m_side = 1;
+        while (m_side < static_cast<uint64_t>(std::max(m_cols, m_rows)))
+            m_side *= 2;
+        m_d_end = m_count ? m_side * m_side : 0;
+    }
+}
+
+LevelTileRange::LevelTileRange(LevelTileRange const& parent, uint64_t d_begin, uint64_t d_end, int64_t count)
+    : LevelTileRange(parent)
+{
+    m_d_begin = d_begin;
+    m_d_end = d_end;
+    m_count = count;
+}
+
+LevelTileRange::iterator LevelTileRange::begin() const
+{
+    return iterator(this, _next_valid(m_d_begin));
+}
+
+LevelTileRange::iterator LevelTileRange::end() const
+{
+    return iterator(this, m_d_end);
+}
+
+std::pair<LevelTileRange, LevelTileRange> LevelTileRange::take(int64_t count) const
+{
+    count = std::clamp(count, int64_t{0}, m_count);
+    uint64_t d = m_d_begin;
+    if (m_order == TileOrder::RowMajor)
+        d += static_cast<uint64_t>(count);
+    else if (count == m_count)
+        d = m_d_end;
+    else
+    {
+        d = _next_valid(d);
+        for (int64_t i = 0; i < count; i++)
+            d = _next_valid(d + 1);
+    }
+    return {LevelTileRange(*this, m_d_begin, d, count), LevelTileRange(*this, d, m_d_end, m_count - count)};
+}
+
+std::vector<LevelTileRange> LevelTileRange::split(int n) const
+{
+    std::vector<LevelTileRange> chunks;
+    if (n <= 0 || m_count == 0) return chunks;
+    n = static_cast<int>(std::min<int64_t>(n, m_count));
+    chunks.reserve(n);
+    auto rest = *this;
+    for (auto i = 0; i < n; i++)
+    {
+        // the first (m_count % n) chunks get one extra tile
+        auto count = m_count / n + (i < m_count % n ? 1 : 0);
+        auto [head, tail] = rest.take(count);
+        chunks.push_back(head);
+        rest = tail;
+    }
+    return chunks;
+}
+
+std::pair<int64_t, int64_t> LevelTileRange::_decode(uint64_t d) const
+{
+    switch (m_order)
+    {
+    case TileOrder::ZOrder:
+        return {static_cast<int64_t>(_compact_bits(d)), static_cast<int64_t>(_compact_bits(d >> 1))};
+    case TileOrder::Hilbert: {
+        auto [x, y] = _hilbert_d2xy(m_side, d);
+        return {static_cast<int64_t>(x), static_cast<int64_t>(y)};
+    }
+    default:
+        return {static_cast<int64_t>(d % m_cols), static_cast<int64_t>(d / m_cols)};
+    }
+}
+
+uint64_t LevelTileRange::_next_valid(uint64_t d) const
+{
+    if (m_order == TileOrder::RowMajor) return std::min(d, m_d_end);
+    while (d < m_d_end)
+    {
+        auto [x, y] = _decode(d);
+        if (x < m_cols && y < m_rows) return d;
+        // an aligned run of 4^k positions covers a 2^k square on both curves,
+        // skip the largest such run starting at d whose square lies completely outside the grid
+        uint64_t run = 1, side = 1;
+        while (run * 4 <= m_d_end - d && d % (run * 4) == 0)
+        {
+            auto ox = static_cast<int64_t>(x - x % (side * 2));
+            auto oy = static_cast<int64_t>(y - y % (side * 2));
+            if (ox < m_cols && oy < m_rows) break;
+            run *= 4;
+            side *= 2;
+        }
+        d += run;
+    }
+    return m_d_end;
+}
+
+LevelTileRange::iterator::iterator(LevelTileRange const* range, uint64_t d) : m_range(range), m_d(d)
+{
+    _settle();
+}
+
+LevelTileRange::iterator& LevelTileRange::iterator::operator++()
+{
+    m_d = m_range->_next_valid(m_d + 1);
+    _settle();
+    return *this;
+}
+
+void LevelTileRange::iterator::_settle()
+{
+    if (!m_range || m_d >= m_range->m_d_end) return;
+    auto [col, row] = m_range->_decode(m_d);
+    m_tile = TileIndex{m_range->m_level, col, row};
+}
+
+TileRange::TileRange(std::vector<std::pair<int64_t, int64_t>> const& level_tiles, TileOrder order, int first_level,
+                     int last_level)
+{
+    if (last_level < 0) last_level = static_cast<int>(level_tiles.size()) - 1;
+    first_level = std::max(0, first_level);
+    last_level = std::min(last_level, static_cast<int>(level_tiles.size()) - 1);
+    for (auto l = first_level; l <= last_level; l++)
+        if (auto r = LevelTileRange(l, level_tiles[l], order); !r.empty()) m_spans.push_back(r);
+}
+
+TileRange::iterator TileRange::begin() const
+{
+    return iterator(this, 0);
+}
+
+TileRange::iterator TileRange::end() const
+{
+    return iterator(this, m_spans.size());
+}
+
+int64_t TileRange::size() const
+{
+    int64_t s = 0;
+    for (auto const& span : m_spans)
+        s += span.size();
+    return s;
+}
+
+std::vector<TileRange> TileRange::split(int n) const
+{
+    auto total = size();
+    if (n <= 0 || total == 0) return {};
+    n = static_cast<int>(std::min<int64_t>(n, total));
+    std::vector<int64_t> sizes(n);
+    for (auto i = 0; i < n; i++)
+        sizes[i] = total / n + (i < total % n ? 1 : 0);
+    return split(sizes);
+}
+
+std::vector<TileRange> TileRange::split(std::vector<int64_t> const& sizes) const
+{
+    std::vector<TileRange> chunks(sizes.size());
+    std::size_t span = 0;
+    auto rest = m_spans.empty() ? LevelTileRange() : m_spans[0];
+    for (std::size_t i = 0; i < sizes.size(); i++)
+    {
+        auto need = sizes[i];
+        while (need > 0)
+        {
+            if (rest.empty())
+            {
+                if (span + 1 >= m_spans.size()) return chunks;
+                rest = m_spans[++span];
+            }
+            auto [head, tail] = rest.take(need);
+            need -= head.size();
+            chunks[i].m_spans.push_back(head);
+            rest = tail;
+        }
+    }
+    return chunks;
+}
+
+TileRange::iterator::iterator(TileRange const* range, std::size_t span) : m_range(range), m_span(span)
+{
+    if (m_span < m_range->m_spans.size()) m_it = m_range->m_spans[m_span].begin();
+    _settle();
+}
+
+TileRange::iterator& TileRange::iterator::operator++()
+{
+    ++m_it;
+    _settle();
+    return *this;
+}
+
+void TileRange::iterator::_settle()
+{
+    // move on to the next non-exhausted span, end() is <spans.size(), default iterator>
+    while (m_span < m_range->m_spans.size() && m_it == m_range->m_spans[m_span].end())
+    {
+        if (++m_span < m_range->m_spans.size())
+            m_it = m_range->m_spans[m_span].begin();
+        else
+            m_it = LevelTileRange::iterator();
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// walking order of the tiles inside a deepzoom level
+// Z-order and Hilbert keep consecutive tiles spatially close, so slide tiles decoded for one dz tile are
+// still in openslide's cache when the neighbouring dz tile is read
+enum class TileOrder
+{
+    RowMajor,
+    ZOrder,
+    Hilbert
+};
+
+struct TileIndex
+{
+    int level = 0;
+    int64_t col = 0;
+    int64_t row = 0;
+
+    bool operator==(TileIndex const& o) const { return level == o.level && col == o.col && row == o.row; }
+    bool operator!=(TileIndex const& o) const { return !(*this == o); }
+};
+
+// the tiles of one deepzoom level, or a contiguous slice of them, in a given order
+// for the space filling curves the grid is embedded in the enclosing power of two square and cells outside
+// the grid are skipped
+class LevelTileRange
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = TileIndex;
+        using difference_type = std::ptrdiff_t;
+        using pointer = TileIndex const*;
+        using reference = TileIndex const&;
+
+        iterator() = default;
+
+        reference operator*() const { return m_tile; }
+        pointer operator->() const { return &m_tile; }
+        iterator& operator++();
+        iterator operator++(int)
+        {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(iterator const& o) const { return m_d == o.m_d; }
+        bool operator!=(iterator const& o) const { return m_d != o.m_d; }
+
+    private:
+        friend class LevelTileRange;
+        iterator(LevelTileRange const* range, uint64_t d);
+        void _settle();
+
+    private:
+        LevelTileRange const* m_range = nullptr;
+        uint64_t m_d = 0; // position on the curve
+        TileIndex m_tile;
+    };
+
+    LevelTileRange() = default;
+    // `tiles` is <col, row> as returned by DeepZoomGenerator::level_tiles()
+    LevelTileRange(int level, std::pair<int64_t, int64_t> tiles, TileOrder order);
+
+    iterator begin() const;
+    iterator end() const;
+    int64_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+    int level() const { return m_level; }
+    TileOrder order() const { return m_order; }
+
+    // <first `count` tiles, the rest>
+    std::pair<LevelTileRange, LevelTileRange> take(int64_t count) const;
+    // at most `n` contiguous slices with sizes differing by at most one
+    std::vector<LevelTileRange> split(int n) const;
+
+private:
+    LevelTileRange(LevelTileRange const& parent, uint64_t d_begin, uint64_t d_end, int64_t count);
+    // position on the curve -> <col, row>, may be outside the grid
+    std::pair<int64_t, int64_t> _decode(uint64_t d) const;
+    // first position >= d that lies inside the grid, or m_d_end
+    uint64_t _next_valid(uint64_t d) const;
+
+private:
+    int m_level = 0;
+    int64_t m_cols = 0;
+    int64_t m_rows = 0;
+    TileOrder m_order = TileOrder::RowMajor;
+    uint64_t m_side = 0; // power of two side of the curve, unused for row-major
+    uint64_t m_d_begin = 0;
+    uint64_t m_d_end = 0;
+    int64_t m_count = 0;
+};
+
+// the tiles of several deepzoom levels, level by level from `first_level` to `last_level`
+class TileRange
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = TileIndex;
+        using difference_type = std::ptrdiff_t;
+        using pointer = TileIndex const*;
+        using reference = TileIndex const&;
+
+        iterator() = default;
+
+        reference operator*() const { return *m_it; }
+        pointer operator->() const { return &*m_it; }
+        iterator& operator++();
+        iterator operator++(int)
+        {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(iterator const& o) const { return m_span == o.m_span && m_it == o.m_it; }
+        bool operator!=(iterator const& o) const { return !(*this == o); }
+
+    private:
+        friend class TileRange;
+        iterator(TileRange const* range, std::size_t span);
+        void _settle();
+
+    private:
+        TileRange const* m_range = nullptr;
+        std::size_t m_span = 0;
+        LevelTileRange::iterator m_it;
+    };
+
+    TileRange() = default;
+    // `level_tiles` as returned by DeepZoomGenerator::level_tiles(), `last_level` = -1 means the last level
+    TileRange(std::vector<std::pair<int64_t, int64_t>> const& level_tiles, TileOrder order, int first_level = 0,
+              int last_level = -1);
+
+    iterator begin() const;
+    iterator end() const;
+    int64_t size() const;
+    bool empty() const { return size() == 0; }
+    std::vector<LevelTileRange> const& spans() const { return m_spans; }
+
+    // at most `n` contiguous chunks with sizes differing by at most one, a chunk may cross level boundaries
+    std::vector<TileRange> split(int n) const;
+    // contiguous chunks of the given sizes, the last chunks come out short (or empty) if the sizes add up to more
+    // than size()
+    std::vector<TileRange> split(std::vector<int64_t> const& sizes) const;
+
+private:
+    std::vector<LevelTileRange> m_spans;
+};
@@ -0,0 +1,179 @@
+#include "tile_pack.hpp"
+#include "content_hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr char kMagic[8] = {'D', 'Z', 'P', 'A', 'C', 'K', '0', '1'};
+    constexpr std::size_t kEntrySize = 4 + 8 + 8 + 8 + 4;
+    constexpr std::size_t kFooterSize = 8 + 8 + sizeof(kMagic);
+
+    void _put(std::vector<uint8_t>& buf, uint64_t v, int size)
+    {
+        for (auto i = 0; i < size; i++)
+            buf.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    uint64_t _get(uint8_t const*& p, int size)
+    {
+        uint64_t v = 0;
+        for (auto i = 0; i < size; i++)
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        p += size;
+        return v;
+    }
+
+    void _put_string(std::vector<uint8_t>& buf, std::string const& s)
+    {
+        _put(buf, s.size(), 8);
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+
+    bool _get_string(uint8_t const*& p, uint8_t const* end, std::string& s)
+    {
+        if (end - p < 8) return false;
+        auto const size = _get(p, 8);
+        if (static_cast<uint64_t>(end - p) < size) return false;
+        s.assign(reinterpret_cast<char const*>(p), size);
+        p += size;
+        return true;
+    }
+} // namespace
+
+TilePackWriter::TilePackWriter(std::string const& path, std::string descriptor, std::string meta, bool dedup)
+    : m_file(path, std::ios::binary | std::ios::trunc), m_descriptor(std::move(descriptor)), m_meta(std::move(meta)),
+      m_dedup_enabled(dedup)
+{
+    m_file.write(kMagic, sizeof(kMagic));
+    m_offset = sizeof(kMagic);
+}
+
+bool TilePackWriter::add(TileIndex const& index, uint8_t const* data, std::size_t size)
+{
+    auto const hash = m_dedup_enabled ? content_hash(data, size) : 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) return false;
+    if (m_dedup_enabled)
+        if (auto offset = m_dedup.find(hash, size); offset)
+        {
+            m_entries.push_back({index, *offset, static_cast<uint32_t>(size)});
+            m_dedup.add_duplicate(size);
+            return true;
+        }
+    m_file.write(reinterpret_cast<char const*>(data), size);
+    m_entries.push_back({index, m_offset, static_cast<uint32_t>(size)});
+    if (m_dedup_enabled) m_dedup.insert(hash, size, m_offset);
+    m_offset += size;
+    return static_cast<bool>(m_file);
+}
+
+bool TilePackWriter::add(TilePackReader const& pack)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<std::mutex> pack_lock(pack.m_mutex);
+    if (!m_file) return false;
+    auto& in = pack.m_file;
+    in.clear();
+    in.seekg(sizeof(kMagic));
+    std::vector<char> buf(4 << 20);
+    for (auto left = pack.m_data_end - sizeof(kMagic); left > 0;)
+    {
+        auto const n = static_cast<std::size_t>(std::min<uint64_t>(left, buf.size()));
+        if (!in.read(buf.data(), n)) return false;
+        m_file.write(buf.data(), n);
+        left -= n;
+    }
+    auto const shift = m_offset - sizeof(kMagic);
+    for (auto e : pack.m_entries)
+    {
+        e.offset += shift;
+        m_entries.push_back(e);
+    }
+    m_offset += pack.m_data_end - sizeof(kMagic);
+    return static_cast<bool>(m_file);
+}
+
+bool TilePackWriter::finish()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint8_t> tail;
+    tail.reserve(m_entries.size() * kEntrySize + m_descriptor.size() + m_meta.size() + 16 + kFooterSize);
+    for (auto const& e : m_entries)
+    {
+        _put(tail, static_cast<uint32_t>(e.index.level), 4);
+        _put(tail, static_cast<uint64_t>(e.index.col), 8);
+        _put(tail, static_cast<uint64_t>(e.index.row), 8);
+        _put(tail, e.offset, 8);
+        _put(tail, e.size, 4);
+    }
+    _put_string(tail, m_descriptor);
+    _put_string(tail, m_meta);
+    _put(tail, m_offset, 8);
+    _put(tail, m_entries.size(), 8);
+    tail.insert(tail.end(), std::begin(kMagic), std::end(kMagic));
+    m_file.write(reinterpret_cast<char const*>(tail.data()), tail.size());
+    m_file.close();
+    return static_cast<bool>(m_file);
+}
+
+std::unique_ptr<TilePackReader> TilePackReader::open(std::string const& path)
+{
+    std::unique_ptr<TilePackReader> pack(new TilePackReader());
+    auto& file = pack->m_file;
+    file.open(path, std::ios::binary | std::ios::ate);
+    if (!file) return nullptr;
+    auto const file_size = static_cast<uint64_t>(file.tellg());
+    if (file_size < sizeof(kMagic) + kFooterSize) return nullptr;
+
+    uint8_t footer[kFooterSize];
+    file.seekg(static_cast<std::streamoff>(file_size - kFooterSize));
+    if (!file.read(reinterpret_cast<char*>(footer), kFooterSize)) return nullptr;
+    if (std::memcmp(footer + 16, kMagic, sizeof(kMagic)) != 0) return nullptr;
+    uint8_t const* p = footer;
+    auto const index_offset = _get(p, 8);
+    auto const count = _get(p, 8);
+    if (index_offset < sizeof(kMagic) || index_offset > file_size - kFooterSize ||
+        count > (file_size - kFooterSize - index_offset) / kEntrySize)
+        return nullptr;
+
+    std::vector<uint8_t> index(file_size - kFooterSize - index_offset);
+    file.seekg(static_cast<std::streamoff>(index_offset));
+    if (!file.read(reinterpret_cast<char*>(index.data()), index.size())) return nullptr;
+    p = index.data();
+    pack->m_entries.resize(count);
+    pack->m_lookup.reserve(count);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        auto& e = pack->m_entries[i];
+        e.index.level = static_cast<int>(_get(p, 4));
+        e.index.col = static_cast<int64_t>(_get(p, 8));
+        e.index.row = static_cast<int64_t>(_get(p, 8));
+        e.offset = _get(p, 8);
+        e.size = static_cast<uint32_t>(_get(p, 4));
+        if (e.offset < sizeof(kMagic) || e.offset + e.size > index_offset) return nullptr;
+        pack->m_lookup[e.index] = i;
+    }
+    auto const* end = index.data() + index.size();
+    if (!_get_string(p, end, pack->m_descriptor) || !_get_string(p, end, pack->m_meta)) return nullptr;
+    pack->m_data_end = index_offset;
+    return pack;
+}
+
+std::vector<uint8_t> TilePackReader::get(TileIndex const& index) const
+{
+    auto it = m_lookup.find(index);
+    if (it == m_lookup.end()) return {};
+    return read(m_entries[it->second]);
+}
+
+std::vector<uint8_t> TilePackReader::read(TilePackEntry const& entry) const
+{
+    std::vector<uint8_t> data(entry.size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(entry.offset));
+    if (!m_file.read(reinterpret_cast<char*>(data.data()), data.size())) return {};
+    return data;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "content_dedup.hpp"
+#include "tile_cache.hpp"
+#include "tile_order.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// single file container of encoded tiles
+// layout: magic, the tile blobs back to back, the index (level, col, row, offset, size per tile), the descriptor and
+// a free form meta string, then a footer with the index offset, the entry count and the magic again
+// integers are little endian, the index goes last so a pack cut short has no valid footer
+struct TilePackEntry
+{
+    TileIndex index;
+    uint64_t offset = 0; // from the start of the file
+    uint32_t size = 0;
+};
+
+class TilePackReader;
+
+class TilePackWriter
+{
+public:
+    // `descriptor` is typically the DZI XML, `meta` anything the producer wants to read back
+    // with `dedup` byte-identical tiles are stored once and their index entries share the offset
+    TilePackWriter(std::string const& path, std::string descriptor, std::string meta = {}, bool dedup = false);
+
+    TilePackWriter(TilePackWriter const&) = delete;
+    TilePackWriter& operator=(TilePackWriter const&) = delete;
+
+    bool ok() const { return static_cast<bool>(m_file); }
+    // thread safe, returns false on I/O error
+    bool add(TileIndex const& index, uint8_t const* data, std::size_t size);
+    // every tile of `pack`, the blobs are copied in one go without looking at them
+    bool add(TilePackReader const& pack);
+    // writes the index and the footer, returns false on I/O error
+    bool finish();
+
+    // tiles passed to add(index, data, size), empty without dedup
+    DedupStats dedup_stats() const { return m_dedup.stats(); }
+
+private:
+    std::mutex m_mutex;
+    std::ofstream m_file;
+    uint64_t m_offset = 0;
+    std::vector<TilePackEntry> m_entries;
+    std::string m_descriptor;
+    std::string m_meta;
+    bool m_dedup_enabled = false;
+    ContentDedup<uint64_t> m_dedup; // offset of each stored payload
+};
+
+class TilePackReader
+{
+public:
+    // nullptr if the file is not a complete pack
+    static std::unique_ptr<TilePackReader> open(std::string const& path);
+
+    std::string const& descriptor() const { return m_descriptor; }
+    std::string const& meta() const { return m_meta; }
+    // in the order the tiles were added
+    std::vector<TilePackEntry> const& entries() const { return m_entries; }
+
+    // thread safe, empty if the tile is not in the pack
+    std::vector<uint8_t> get(TileIndex const& index) const;
+    std::vector<uint8_t> read(TilePackEntry const& entry) const;
+
+private:
+    friend class TilePackWriter;
+    TilePackReader() = default;
+
+private:
+    mutable std::mutex m_mutex;
+    mutable std::ifstream m_file;
+    std::vector<TilePackEntry> m_entries;
+    std::unordered_map<TileIndex, std::size_t, TileIndexHash> m_lookup;
+    std::string m_descriptor;
+    std::string m_meta;
+    uint64_t m_data_end = 0; // the blobs are [magic size, m_data_end)
+};
@@ -0,0 +1,147 @@
+#include "tile_scheduler.hpp"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(Render render, int threads) : m_render(std::move(render))
+{
+    auto n = threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    m_workers.reserve(n);
+    for (auto i = 0; i < n; i++)
+        m_workers.emplace_back([this]() { _run(); });
+}
+
+TileScheduler::~TileScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        _cancel_if([](Job const&) { return true; });
+    }
+    m_cv.notify_all();
+    for (auto& w : m_workers)
+        w.join();
+}
+
+std::shared_future<TilePtr> TileScheduler::submit(uint64_t session, uint64_t generation, TilePriority priority,
+                                                  TileIndex const& index)
+{
+    return submit(session, generation, priority, index, nullptr);
+}
+
+std::shared_future<TilePtr> TileScheduler::submit(uint64_t session, uint64_t generation, TilePriority priority,
+                                                  TileIndex const& index, Render const* render)
+{
+    Job job{session, generation, index, {}, render, std::chrono::steady_clock::now()};
+    auto future = job.promise.get_future().share();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.submitted[static_cast<int>(priority)]++;
+        auto const pinned = session == kPinnedSession;
+        auto* current = pinned ? nullptr : &m_generations[session];
+        if (m_stop || (current && generation < *current))
+        {
+            m_stats.cancelled++;
+            job.promise.set_value(nullptr);
+            return future;
+        }
+        if (current && generation > *current)
+        {
+            *current = generation;
+            _cancel_if([&](Job const& j) { return j.session == session && j.generation < generation; });
+        }
+        m_queues[static_cast<int>(priority)].push_back(std::move(job));
+    }
+    m_cv.notify_one();
+    return future;
+}
+
+void TileScheduler::advance(uint64_t session, uint64_t generation)
+{
+    if (session == kPinnedSession) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& current = m_generations[session];
+    if (generation <= current) return;
+    current = generation;
+    _cancel_if([&](Job const& j) { return j.session == session && j.generation < generation; });
+}
+
+void TileScheduler::end_session(uint64_t session)
+{
+    if (session == kPinnedSession) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generations.erase(session);
+    _cancel_if([&](Job const& j) { return j.session == session; });
+}
+
+void TileScheduler::cancel_render(Render const* render)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    _cancel_if([&](Job const& j) { return j.render == render; });
+    m_render_done_cv.wait(lock, [&]() { return m_running_renders.count(render) == 0; });
+}
+
+TileScheduler::Stats TileScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto s = m_stats;
+    for (auto p = 0; p < 3; p++)
+        s.queued[p] = m_queues[p].size();
+    return s;
+}
+
+void TileScheduler::_cancel_if(std::function<bool(Job const&)> const& stale)
+{
+    for (auto& queue : m_queues)
+    {
+        auto it = std::stable_partition(queue.begin(), queue.end(), [&](Job const& j) { return !stale(j); });
+        for (auto c = it; c != queue.end(); c++)
+        {
+            c->promise.set_value(nullptr);
+            m_stats.cancelled++;
+        }
+        queue.erase(it, queue.end());
+    }
+}
+
+void TileScheduler::_run()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() {
+                return m_stop || std::any_of(m_queues.begin(), m_queues.end(), [](auto const& q) { return !q.empty(); });
+            });
+            // highest priority first, FIFO within a priority
+            auto queue = std::find_if(m_queues.begin(), m_queues.end(), [](auto const& q) { return !q.empty(); });
+            if (queue == m_queues.end()) return;
+            job = std::move(queue->front());
+            queue->pop_front();
+            m_stats.running++;
+            if (job.render) m_running_renders[job.render]++;
+        }
+        auto const started = std::chrono::steady_clock::now();
+
+        try
+        {
+            job.promise.set_value(job.render ? (*job.render)(job.index) : m_render(job.index));
+        }
+        catch (...)
+        {
+            job.promise.set_exception(std::current_exception());
+        }
+
+        auto const finished = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.running--;
+        m_stats.completed++;
+        m_stats.queued_seconds += std::chrono::duration<double>(started - job.submitted).count();
+        m_stats.render_seconds += std::chrono::duration<double>(finished - started).count();
+        if (job.render && --m_running_renders[job.render] == 0)
+        {
+            m_running_renders.erase(job.render);
+            m_render_done_cv.notify_all();
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "tile_cache.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+enum class TilePriority
+{
+    Visible = 0,  // tiles inside the current viewport
+    Prefetch = 1, // tiles the viewer will probably need next
+    Export = 2    // bulk work, only runs when nothing interactive is queued
+};
+
+// priority queue of tile renders in front of get_tile
+// every request belongs to a session (a viewer) and a generation (one of its viewports); once a session moves on to
+// a newer generation its queued requests of older generations are cancelled, so workers only render tiles that are
+// still wanted
+// requests may bring their own Render, so one worker pool can serve several slides
+class TileScheduler
+{
+public:
+    using Render = std::function<TilePtr(TileIndex const&)>;
+
+    struct Stats
+    {
+        std::array<std::size_t, 3> queued{}; // per priority
+        std::size_t running = 0;
+        std::array<uint64_t, 3> submitted{}; // per priority
+        uint64_t completed = 0;
+        uint64_t cancelled = 0;
+        double queued_seconds = 0.; // summed over the completed requests, from submit until a worker took them
+        double render_seconds = 0.; // summed over the completed requests
+    };
+
+    // session whose requests are never cancelled, advance() and end_session() ignore it
+    static constexpr uint64_t kPinnedSession = UINT64_MAX;
+
+    // `threads` = 0 means hardware concurrency, `render` may be empty if every request brings its own
+    explicit TileScheduler(Render render, int threads = 0);
+    ~TileScheduler();
+
+    TileScheduler(TileScheduler const&) = delete;
+    TileScheduler& operator=(TileScheduler const&) = delete;
+
+    // the future holds nullptr if the request was cancelled before it ran
+    // submitting a newer generation advances the session, submitting an outdated one is cancelled right away
+    std::shared_future<TilePtr> submit(uint64_t session, uint64_t generation, TilePriority priority,
+                                       TileIndex const& index);
+    // rendered by `render` instead of the scheduler's own, which must stay valid until cancel_render(render)
+    std::shared_future<TilePtr> submit(uint64_t session, uint64_t generation, TilePriority priority,
+                                       TileIndex const& index, Render const* render);
+    // cancel the queued requests rendered by `render` and wait for its running ones to finish
+    void cancel_render(Render const* render);
+    // cancel the queued requests of `session` older than `generation`
+    void advance(uint64_t session, uint64_t generation);
+    // cancel all queued requests of `session` and forget it
+    void end_session(uint64_t session);
+
+    Stats stats() const;
+
+private:
+    struct Job
+    {
+        uint64_t session;
+        uint64_t generation;
+        TileIndex index;
+        std::promise<TilePtr> promise;
+        Render const* render = nullptr; // nullptr for m_render
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void _run();
+    // with m_mutex held
+    void _cancel_if(std::function<bool(Job const&)> const& stale);
+
+private:
+    Render m_render;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_render_done_cv;
+    std::unordered_map<Render const*, int> m_running_renders; // running jobs per non-default render
+    std::array<std::deque<Job>, 3> m_queues;            // FIFO per priority
+    std::unordered_map<uint64_t, uint64_t> m_generations; // session -> current generation
+    Stats m_stats;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+};
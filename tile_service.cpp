@@ -0,0 +1,193 @@
+#include "tile_service.hpp"
+#include "image_ops.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+TileService::TileService(DeepZoomGenerator const& generator, std::size_t cache_bytes, int threads)
+    : TileService(generator, TileCacheTiers{cache_bytes}, threads)
+{
+}
+
+TileService::TileService(DeepZoomGenerator const& generator, TileCacheTiers const& tiers, int threads)
+    : TileService(generator, tiers, std::make_shared<TileScheduler>(TileScheduler::Render{}, threads))
+{
+}
+
+TileService::TileService(DeepZoomGenerator const& generator, TileCacheTiers const& tiers,
+                         std::shared_ptr<TileScheduler> scheduler)
+    : m_generator(&generator), m_cache(tiers),
+      m_scheduled_render([this](TileIndex const& index) {
+          // it may have been rendered while the request was queued
+          if (auto tile = m_cache.peek(index); tile) return tile;
+          return _render(index);
+      }),
+      m_scheduler(std::move(scheduler))
+{
+}
+
+TileService::~TileService()
+{
+    // the scheduler may outlive this service, none of its workers may still be in here
+    m_scheduler->cancel_render(&m_scheduled_render);
+}
+
+TilePtr TileService::get_tile(int dz_level, int col, int row, TileOutcome* outcome)
+{
+    TileIndex index{dz_level, col, row};
+    auto const start = std::chrono::steady_clock::now();
+    auto cold_hit = false, coalesced = false;
+    auto tile = m_cache.get(index, &cold_hit);
+    auto result = cold_hit ? TileOutcome::ColdHit : TileOutcome::HotHit;
+    if (!tile)
+    {
+        tile = _render(index, &coalesced);
+        result = coalesced ? TileOutcome::Coalesced : TileOutcome::Rendered;
+    }
+    _log(index, start, result);
+    if (outcome) *outcome = result;
+    return tile;
+}
+
+TileResult TileService::get_tile(int dz_level, int col, int row, std::chrono::steady_clock::time_point deadline)
+{
+    TileIndex index{dz_level, col, row};
+    auto const start = std::chrono::steady_clock::now();
+    auto cold_hit = false;
+    if (auto tile = m_cache.get(index, &cold_hit); tile)
+    {
+        auto const outcome = cold_hit ? TileOutcome::ColdHit : TileOutcome::HotHit;
+        _log(index, start, outcome, deadline - start);
+        return {tile, false, outcome};
+    }
+
+    // join a render that is already running, otherwise queue one in the pinned session no viewer can cancel
+    auto future = _in_flight(index);
+    auto const outcome = future.valid() ? TileOutcome::Coalesced : TileOutcome::Rendered;
+    if (!future.valid())
+        future = m_scheduler->submit(TileScheduler::kPinnedSession, 0, TilePriority::Visible, index,
+                                     &m_scheduled_render);
+    if (future.wait_until(deadline) == std::future_status::ready)
+    {
+        // nullptr if the request was cancelled after all (the scheduler is shutting down), served provisionally
+        if (auto tile = future.get(); tile)
+        {
+            _log(index, start, outcome, deadline - start);
+            return {tile, false, outcome};
+        }
+    }
+    // dropping the future does not cancel the render, it still fills the cache
+    m_provisional++;
+    auto tile = _placeholder(index);
+    _log(index, start, TileOutcome::Provisional, deadline - start);
+    return {tile, true, TileOutcome::Provisional};
+}
+
+void TileService::set_access_log(std::shared_ptr<AccessLogWriter> log, std::string const& slide_path)
+{
+    if (log)
+        m_access_log_slide = log->add_slide(
+            {slide_path, m_generator->tile_size(), m_generator->overlap(), m_generator->limit_bounds()});
+    m_access_log = std::move(log);
+}
+
+std::shared_future<TilePtr> TileService::request(uint64_t session, uint64_t generation, TilePriority priority,
+                                                 int dz_level, int col, int row)
+{
+    return m_scheduler->submit(session, generation, priority, TileIndex{dz_level, col, row}, &m_scheduled_render);
+}
+
+TilePtr TileService::_render(TileIndex const& index, bool* coalesced)
+{
+    std::promise<TilePtr> promise;
+    std::shared_future<TilePtr> running;
+    {
+        std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+        if (auto it = m_in_flight.find(index); it != m_in_flight.end())
+            running = it->second;
+        else
+            m_in_flight.emplace(index, promise.get_future().share());
+    }
+    if (coalesced) *coalesced = running.valid();
+    if (running.valid())
+    {
+        m_coalesced++;
+        return running.get();
+    }
+
+    TilePtr tile;
+    std::exception_ptr error;
+    try
+    {
+        // the previous leader may have finished between our cache miss and taking the lock
+        tile = m_cache.peek(index);
+        if (!tile)
+        {
+            auto [w, h, data] =
+                m_generator->get_tile(index.level, static_cast<int>(index.col), static_cast<int>(index.row));
+            tile = std::make_shared<Tile const>(Tile{w, h, std::move(data)});
+            m_cache.put(index, tile);
+        }
+        promise.set_value(tile);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+        promise.set_exception(error);
+    }
+
+    // the tile is in the cache before it leaves the in-flight table, so later requests find one or the other
+    {
+        std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+        m_in_flight.erase(index);
+    }
+    if (error) std::rethrow_exception(error);
+    return tile;
+}
+
+std::shared_future<TilePtr> TileService::_in_flight(TileIndex const& index) const
+{
+    std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+    auto it = m_in_flight.find(index);
+    return it == m_in_flight.end() ? std::shared_future<TilePtr>() : it->second;
+}
+
+TilePtr TileService::_placeholder(TileIndex const& index) const
+{
+    auto const ts = m_generator->tile_size();
+    auto const overlap = m_generator->overlap();
+    auto const [zw, zh] =
+        m_generator->get_tile_dimensions(index.level, static_cast<int>(index.col), static_cast<int>(index.row));
+    // top left of the tile including its overlap, in the tile's own level
+    auto const x = static_cast<double>(index.col * ts - (index.col != 0 ? overlap : 0));
+    auto const y = static_cast<double>(index.row * ts - (index.row != 0 ? overlap : 0));
+
+    for (auto k = 1; k <= index.level; k++)
+    {
+        TileIndex parent{index.level - k, index.col >> k, index.row >> k};
+        auto tile = m_cache.peek(parent);
+        if (!tile) continue;
+
+        // the same area in the parent tile
+        auto const f = static_cast<double>(int64_t{1} << k);
+        auto const px = x / f - (parent.col * ts - (parent.col != 0 ? overlap : 0));
+        auto const py = y / f - (parent.row * ts - (parent.row != 0 ? overlap : 0));
+        auto const x0 = std::clamp(static_cast<int64_t>(std::floor(px)), int64_t{0}, int64_t{tile->width - 1});
+        auto const y0 = std::clamp(static_cast<int64_t>(std::floor(py)), int64_t{0}, int64_t{tile->height - 1});
+        auto const x1 = std::clamp(static_cast<int64_t>(std::ceil(px + zw / f)), x0 + 1, int64_t{tile->width});
+        auto const y1 = std::clamp(static_cast<int64_t>(std::ceil(py + zh / f)), y0 + 1, int64_t{tile->height});
+        auto crop = crop_bgra(tile->data, tile->width, x0, y0, x1 - x0, y1 - y0);
+        return std::make_shared<Tile const>(
+            Tile{static_cast<int>(zw), static_cast<int>(zh), resize_bgra(crop, x1 - x0, y1 - y0, zw, zh)});
+    }
+    return std::make_shared<Tile const>(
+        Tile{static_cast<int>(zw), static_cast<int>(zh), std::vector<uint8_t>(zw * zh * 4, 0)});
+}
+
+void TileService::_log(TileIndex const& index, std::chrono::steady_clock::time_point start, TileOutcome outcome,
+                       std::optional<std::chrono::steady_clock::duration> deadline) const
+{
+    if (!m_access_log) return;
+    m_access_log->record(m_access_log_slide, index, start, std::chrono::steady_clock::now() - start, outcome,
+                         deadline);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "access_log.hpp"
+#include "deepzoom.hpp"
+#include "tile_scheduler.hpp"
+#include "tiered_tile_cache.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
+struct TileResult
+{
+    TilePtr tile;
+    // true if `tile` is an upsampled crop of a cached parent level tile standing in for the real one
+    bool provisional = false;
+    TileOutcome outcome = TileOutcome::Rendered;
+};
+
+// cached tile access in front of DeepZoomGenerator::get_tile
+// concurrent requests for the same tile are coalesced: the first one renders it, the others wait on its result
+class TileService
+{
+public:
+    // the generator must outlive the service, `threads` = 0 means hardware concurrency
+    TileService(DeepZoomGenerator const& generator, std::size_t cache_bytes = std::size_t{512} << 20,
+                int threads = 0);
+    // with a compressed cold tier behind the raw tile cache
+    TileService(DeepZoomGenerator const& generator, TileCacheTiers const& tiers, int threads = 0);
+    // renders queued on `scheduler`, which can be shared by the services of several slides
+    TileService(DeepZoomGenerator const& generator, TileCacheTiers const& tiers,
+                std::shared_ptr<TileScheduler> scheduler);
+    // cancels the queued renders of this service and waits for the running ones
+    ~TileService();
+
+    TileService(TileService const&) = delete;
+    TileService& operator=(TileService const&) = delete;
+
+    // cached tile, or rendered on the calling thread, `outcome` if given is set to how it was served
+    TilePtr get_tile(int dz_level, int col, int row, TileOutcome* outcome = nullptr);
+    // returns by `deadline`: the real tile if it is cached or rendered in time, otherwise a provisional tile cut from
+    // the closest cached ancestor (transparent if there is none) while the real tile finishes in the background and
+    // lands in the cache for the next request
+    TileResult get_tile(int dz_level, int col, int row, std::chrono::steady_clock::time_point deadline);
+    // queue a tile render on the scheduler, see TileScheduler::submit
+    // TileScheduler::kPinnedSession is where the deadline get_tile queues its renders, they are never cancelled
+    std::shared_future<TilePtr> request(uint64_t session, uint64_t generation, TilePriority priority, int dz_level,
+                                        int col, int row);
+
+    // record every get_tile call (start, tile, latency, how it was served) to `log` under `slide_path`, call before
+    // serving, nullptr stops recording
+    void set_access_log(std::shared_ptr<AccessLogWriter> log, std::string const& slide_path);
+
+    DeepZoomGenerator const& generator() const { return *m_generator; }
+    TieredTileCache& cache() { return m_cache; }
+    TileScheduler& scheduler() { return *m_scheduler; }
+    uint64_t provisional_count() const { return m_provisional; }
+    // requests that waited on an identical in-flight render instead of rendering themselves
+    uint64_t coalesced_count() const { return m_coalesced; }
+
+private:
+    // single-flight render, only the first caller per tile calls the generator, `coalesced` if given is set to
+    // whether this call waited on another one instead
+    TilePtr _render(TileIndex const& index, bool* coalesced = nullptr);
+    std::shared_future<TilePtr> _in_flight(TileIndex const& index) const;
+    TilePtr _placeholder(TileIndex const& index) const;
+    void _log(TileIndex const& index, std::chrono::steady_clock::time_point start, TileOutcome outcome,
+              std::optional<std::chrono::steady_clock::duration> deadline = std::nullopt) const;
+
+private:
+    DeepZoomGenerator const* m_generator = nullptr;
+    TieredTileCache m_cache;
+    std::atomic<uint64_t> m_provisional{0};
+    std::atomic<uint64_t> m_coalesced{0};
+    std::shared_ptr<AccessLogWriter> m_access_log;
+    uint16_t m_access_log_slide = 0;
+    mutable std::mutex m_in_flight_mutex;
+    std::unordered_map<TileIndex, std::shared_future<TilePtr>, TileIndexHash> m_in_flight;
+    TileScheduler::Render m_scheduled_render; // what the scheduler's workers run for this service
+    std::shared_ptr<TileScheduler> m_scheduler;
+};
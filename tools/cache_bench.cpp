@@ -0,0 +1,84 @@
+#include "deepzoom.hpp"
+#include "tile_order.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// slide read latency for a range of shared openslide cache sizes
+// every capacity opens the slide afresh and reads the same Hilbert ordered run of dz tiles twice: the first pass
+// starts cold, the second one shows how much of the working set the cache kept
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << ": <slide path> [capacities_mib=0,16,64,256,1024] [tiles=256] [dz_level]"
+                  << std::endl
+                  << "capacity 0 means openslide's private per-slide cache" << std::endl;
+        return -1;
+    }
+
+    std::vector<std::size_t> capacities;
+    std::string list = argc > 2 ? argv[2] : "0,16,64,256,1024";
+    for (std::size_t pos = 0; pos < list.size();)
+    {
+        auto end = std::min(list.find(',', pos), list.size());
+        capacities.push_back(std::strtoull(list.substr(pos, end - pos).c_str(), nullptr, 10));
+        pos = end + 1;
+    }
+    auto const tiles = argc > 3 ? std::atoll(argv[3]) : 256;
+
+    std::printf("%12s %12s %12s %12s %12s\n", "cache_mib", "cold_ms", "warm_ms", "warm_p50_ms", "warm_p99_ms");
+    for (auto mib : capacities)
+    {
+        SlideCache::set_shared_capacity(mib << 20);
+        auto source = open_slide_source(argv[1]);
+        if (!source)
+        {
+            std::cerr << "Failed to open slide: " << argv[1] << std::endl;
+            return -1;
+        }
+        DeepZoomGenerator generator(source);
+        auto const dz_level = argc > 4 ? std::atoi(argv[4]) : generator.level_count() - 1;
+        auto const run =
+            LevelTileRange(dz_level, generator.level_tiles()[dz_level], TileOrder::Hilbert).take(tiles).first;
+
+        std::vector<uint32_t> buf;
+        auto pass = [&]() {
+            std::vector<double> ms;
+            for (auto const& t : run)
+            {
+                auto const [l0, level, size] =
+                    generator.get_tile_coordinates(t.level, static_cast<int>(t.col), static_cast<int>(t.row));
+                buf.resize(size.first * size.second);
+                auto start = std::chrono::steady_clock::now();
+                source->read_region(buf.data(), l0.first, l0.second, level, size.first, size.second);
+                ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                                 .count());
+            }
+            return ms;
+        };
+        auto mean = [](std::vector<double> const& v) {
+            double s = 0.;
+            for (auto x : v)
+                s += x;
+            return v.empty() ? 0. : s / v.size();
+        };
+        auto percentile = [](std::vector<double> v, double p) {
+            if (v.empty()) return 0.;
+            std::sort(v.begin(), v.end());
+            return v[std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()))];
+        };
+
+        auto cold = pass();
+        auto warm = pass();
+        std::printf("%12s %12.3f %12.3f %12.3f %12.3f\n", mib ? std::to_string(mib).c_str() : "private", mean(cold),
+                    mean(warm), percentile(warm, 0.5), percentile(warm, 0.99));
+    }
+    SlideCache::set_shared_capacity(0);
+    return 0;
+}
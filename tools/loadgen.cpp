@@ -0,0 +1,274 @@
+#include "access_log.hpp"
+#include "tile_service.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct LoadOptions
+    {
+        double seconds = 10.;
+        double think_ms = 300.; // mean pause between two views
+        int viewport_width = 1600;
+        int viewport_height = 900;
+        int threads = 0; // render workers of the service, 0 = hardware concurrency
+        uint32_t seed = 1;
+    };
+
+    struct LoadResult
+    {
+        int users = 0;
+        double seconds = 0.;
+        std::vector<double> tile_ms;
+        std::vector<double> view_ms; // until every tile of a view arrived
+        uint64_t hits = 0;
+        TileScheduler::Stats scheduler; // the renders behind the misses
+    };
+
+    // long enough that every request gets its real tile rather than a provisional one
+    constexpr auto kWait = std::chrono::seconds(60);
+
+    double _percentile(std::vector<double>& v, double p)
+    {
+        if (v.empty()) return 0.;
+        auto const k = std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()));
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+
+    // one viewer: opens the slide fitted to the viewport, then pans most of the time, zooms in and out, and now and
+    // then jumps somewhere else, pausing for an exponentially distributed think time between views
+    class ViewerSession
+    {
+    public:
+        ViewerSession(DeepZoomGenerator const& generator, LoadOptions const& options, uint32_t seed)
+            : m_dims(generator.level_dimensions()), m_tile_size(generator.tile_size()), m_options(options),
+              m_rng(seed)
+        {
+            _jump(_fit_level());
+        }
+
+        // the tiles in view after the next action
+        std::vector<TileIndex> next_view()
+        {
+            std::uniform_real_distribution<double> u(0., 1.);
+            auto const action = u(m_rng);
+            auto const top = static_cast<int>(m_dims.size()) - 1;
+            if (action < .6)
+            {
+                // pan by a tenth to half of the viewport in any direction
+                auto const angle = u(m_rng) * 6.283185307179586;
+                auto const distance = .1 + .4 * u(m_rng);
+                m_x += std::cos(angle) * distance * m_options.viewport_width;
+                m_y += std::sin(angle) * distance * m_options.viewport_height;
+            }
+            else if (action < .8 && m_level < top)
+            {
+                m_level++;
+                m_x *= 2.;
+                m_y *= 2.;
+            }
+            else if (action < .9 && m_level > _fit_level())
+            {
+                m_level--;
+                m_x /= 2.;
+                m_y /= 2.;
+            }
+            else
+                _jump(_fit_level() + static_cast<int>(u(m_rng) * (top - _fit_level() + 1)));
+            _clamp();
+            return _visible();
+        }
+
+        std::chrono::microseconds think_time()
+        {
+            std::exponential_distribution<double> think(1. / std::max(1e-3, m_options.think_ms));
+            return std::chrono::microseconds(static_cast<int64_t>(think(m_rng) * 1000.));
+        }
+
+    private:
+        // the largest level that fits the viewport
+        int _fit_level() const
+        {
+            auto level = 0;
+            for (auto l = 0; l < static_cast<int>(m_dims.size()); l++)
+                if (m_dims[l].first <= m_options.viewport_width && m_dims[l].second <= m_options.viewport_height)
+                    level = l;
+            return level;
+        }
+
+        void _jump(int level)
+        {
+            std::uniform_real_distribution<double> u(0., 1.);
+            m_level = std::clamp(level, 0, static_cast<int>(m_dims.size()) - 1);
+            m_x = u(m_rng) * m_dims[m_level].first;
+            m_y = u(m_rng) * m_dims[m_level].second;
+            _clamp();
+        }
+
+        void _clamp()
+        {
+            m_x = std::clamp(m_x, 0., static_cast<double>(m_dims[m_level].first));
+            m_y = std::clamp(m_y, 0., static_cast<double>(m_dims[m_level].second));
+        }
+
+        std::vector<TileIndex> _visible() const
+        {
+            auto const [w, h] = m_dims[m_level];
+            auto const ts = static_cast<int64_t>(m_tile_size);
+            auto range = [ts](double center, int viewport, int64_t size) {
+                auto const first = std::clamp(static_cast<int64_t>(center - viewport / 2.), int64_t{0}, size - 1);
+                auto const last = std::clamp(static_cast<int64_t>(center + viewport / 2.), int64_t{0}, size - 1);
+                return std::make_pair(first / ts, last / ts);
+            };
+            auto const [c0, c1] = range(m_x, m_options.viewport_width, w);
+            auto const [r0, r1] = range(m_y, m_options.viewport_height, h);
+            std::vector<TileIndex> tiles;
+            for (auto r = r0; r <= r1; r++)
+                for (auto c = c0; c <= c1; c++)
+                    tiles.push_back({m_level, c, r});
+            return tiles;
+        }
+
+    private:
+        std::vector<std::pair<int64_t, int64_t>> m_dims;
+        int m_tile_size = 254;
+        LoadOptions m_options;
+        std::mt19937 m_rng;
+        int m_level = 0;
+        double m_x = 0., m_y = 0.; // view center in level pixels
+    };
+
+    LoadResult _run(DeepZoomGenerator const& generator, TileCacheTiers const& tiers, int users,
+                    LoadOptions const& options, std::shared_ptr<AccessLogWriter> const& log, std::string const& path)
+    {
+        TileService service(generator, tiers, options.threads);
+        if (log) service.set_access_log(log, path);
+        LoadResult result;
+        result.users = users;
+        std::mutex result_mutex;
+        auto const start = std::chrono::steady_clock::now();
+        auto const end = start + std::chrono::microseconds(static_cast<int64_t>(options.seconds * 1e6));
+
+        std::vector<std::thread> threads;
+        for (auto u = 0; u < users; u++)
+            threads.emplace_back([&, u]() {
+                ViewerSession session(generator, options, options.seed * 7919u + static_cast<uint32_t>(u));
+                std::vector<double> tile_ms, view_ms;
+                uint64_t hits = 0;
+                while (std::chrono::steady_clock::now() < end)
+                {
+                    auto const view_start = std::chrono::steady_clock::now();
+                    for (auto const& t : session.next_view())
+                    {
+                        // cache hits are answered on this thread, misses queue for the service's render workers
+                        auto const t0 = std::chrono::steady_clock::now();
+                        auto const outcome =
+                            service.get_tile(t.level, static_cast<int>(t.col), static_cast<int>(t.row), t0 + kWait)
+                                .outcome;
+                        auto const t1 = std::chrono::steady_clock::now();
+                        tile_ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+                        hits += outcome == TileOutcome::HotHit || outcome == TileOutcome::ColdHit;
+                    }
+                    view_ms.push_back(
+                        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - view_start)
+                            .count());
+                    auto const wake = std::chrono::steady_clock::now() + session.think_time();
+                    std::this_thread::sleep_until(std::min(end, wake));
+                }
+                std::lock_guard<std::mutex> lock(result_mutex);
+                result.tile_ms.insert(result.tile_ms.end(), tile_ms.begin(), tile_ms.end());
+                result.view_ms.insert(result.view_ms.end(), view_ms.begin(), view_ms.end());
+                result.hits += hits;
+            });
+        for (auto& thread : threads)
+            thread.join();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.scheduler = service.scheduler().stats();
+        return result;
+    }
+} // namespace
+
+// simulated viewer sessions against DeepZoomGenerator through TileService, for capacity planning
+// each user pans, zooms and jumps through the slide with think times between views, requesting every tile of its
+// viewport; cache misses are rendered by the service's `threads` render workers, so the time a miss spends queued
+// for a worker is reported apart from the render itself; the user counts run one after another on a fresh cache, and
+// the step where more users stop adding throughput is reported as the saturation point
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << ": <slide path> [users=1,2,4,8,16,32] [seconds=10] [think_ms=300] [viewport=1600x900] "
+                     "[hot_cache_mib=512] [cold_cache_mib=0] [threads=0] [access log]"
+                  << std::endl;
+        return -1;
+    }
+
+    auto source = open_slide_source(argv[1]);
+    if (!source)
+    {
+        std::cerr << "Failed to open slide: " << argv[1] << std::endl;
+        return -1;
+    }
+    DeepZoomGenerator generator(source);
+
+    std::vector<int> user_counts;
+    std::string list = argc > 2 ? argv[2] : "1,2,4,8,16,32";
+    for (std::size_t pos = 0; pos < list.size();)
+    {
+        auto end = std::min(list.find(',', pos), list.size());
+        user_counts.push_back(std::max(1, std::atoi(list.substr(pos, end - pos).c_str())));
+        pos = end + 1;
+    }
+    LoadOptions options;
+    if (argc > 3) options.seconds = std::atof(argv[3]);
+    if (argc > 4) options.think_ms = std::atof(argv[4]);
+    if (argc > 5) std::sscanf(argv[5], "%dx%d", &options.viewport_width, &options.viewport_height);
+    TileCacheTiers tiers;
+    if (argc > 6) tiers.hot_bytes = std::strtoull(argv[6], nullptr, 10) << 20;
+    if (argc > 7) tiers.cold_bytes = std::strtoull(argv[7], nullptr, 10) << 20;
+    if (argc > 8) options.threads = std::max(0, std::atoi(argv[8]));
+    auto const log = argc > 9 ? std::make_shared<AccessLogWriter>(argv[9]) : nullptr;
+
+    std::printf("%6s %9s %10s %7s %9s %9s %9s %11s %11s %9s %10s\n", "users", "tiles", "tiles/s", "hit%", "p50_ms",
+                "p99_ms", "p999_ms", "view_p50_ms", "view_p99_ms", "queue_ms", "render_ms");
+    double best = 0., previous = 0.;
+    int saturation = 0, previous_users = 0;
+    for (auto users : user_counts)
+    {
+        auto r = _run(generator, tiers, users, options, log, argv[1]);
+        auto const throughput = r.seconds > 0. ? r.tile_ms.size() / r.seconds : 0.;
+        // mean per render, queued waiting for a free worker and rendering
+        auto const renders = static_cast<double>(std::max<uint64_t>(1, r.scheduler.completed));
+        std::printf("%6d %9zu %10.1f %6.1f%% %9.2f %9.2f %9.2f %11.2f %11.2f %9.2f %10.2f\n", users, r.tile_ms.size(),
+                    throughput, r.tile_ms.empty() ? 0. : 100. * r.hits / r.tile_ms.size(), _percentile(r.tile_ms, .5),
+                    _percentile(r.tile_ms, .99), _percentile(r.tile_ms, .999), _percentile(r.view_ms, .5),
+                    _percentile(r.view_ms, .99), r.scheduler.queued_seconds * 1e3 / renders,
+                    r.scheduler.render_seconds * 1e3 / renders);
+        std::fflush(stdout);
+        // saturated once the added users get less than half of their share of throughput, the rest is queueing
+        if (saturation == 0 && previous_users > 0 && users > previous_users &&
+            throughput - previous < .5 * previous * (users - previous_users) / previous_users)
+            saturation = users;
+        previous = throughput;
+        previous_users = users;
+        best = std::max(best, throughput);
+    }
+    if (saturation > 0)
+        std::printf("Saturated at %d users, peak %.1f tiles/s\n", saturation, best);
+    else
+        std::printf("Not saturated, peak %.1f tiles/s, try more users\n", best);
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "access_log.hpp"
+#include "tile_service.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    double _percentile(std::vector<double>& v, double p)
+    {
+        if (v.empty()) return 0.;
+        auto const k = std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()));
+        std::nth_element(v.begin(), v.begin() + k, v.end());
+        return v[k];
+    }
+
+    char const* _outcome_name(TileOutcome outcome)
+    {
+        switch (outcome)
+        {
+        case TileOutcome::Rendered:
+            return "rendered";
+        case TileOutcome::HotHit:
+            return "hot_hit";
+        case TileOutcome::ColdHit:
+            return "cold_hit";
+        case TileOutcome::Coalesced:
+            return "coalesced";
+        case TileOutcome::Provisional:
+            return "provisional";
+        }
+        return "?";
+    }
+
+    void _report(char const* name, std::vector<double> latencies_ms, std::vector<uint64_t> const& outcomes)
+    {
+        std::printf("%-9s %9zu %9.3f %9.3f %9.3f %9.3f", name, latencies_ms.size(), _percentile(latencies_ms, .5),
+                    _percentile(latencies_ms, .9), _percentile(latencies_ms, .99), _percentile(latencies_ms, .999));
+        for (std::size_t o = 0; o < outcomes.size(); o++)
+            std::printf("  %s %llu", _outcome_name(static_cast<TileOutcome>(o)),
+                        static_cast<unsigned long long>(outcomes[o]));
+        std::printf("\n");
+    }
+} // namespace
+
+// re-runs a recorded access log against DeepZoomGenerator and the tile caches
+// requests start at their recorded time divided by `speed` (0 = back to back, as fast as the threads go), so cache
+// sizes and policies can be compared on real browsing sessions
+// requests logged with a deadline are replayed with the same deadline from their replayed start, the cache budget is
+// split evenly across the slides and their background renders share one worker pool
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << ": <access log> [speed=1] [hot_cache_mib=512] [cold_cache_mib=0] [threads=8] [slide path]"
+                  << std::endl
+                  << "speed 0 replays back to back, the cache sizes are split evenly across the slides, a slide "
+                     "path replaces every slide of the log"
+                  << std::endl;
+        return -1;
+    }
+    auto log = AccessLog::read(argv[1]);
+    if (!log)
+    {
+        std::cerr << "Failed to read access log: " << argv[1] << std::endl;
+        return -1;
+    }
+    auto const speed = argc > 2 ? std::atof(argv[2]) : 1.;
+    TileCacheTiers tiers;
+    if (argc > 3) tiers.hot_bytes = std::strtoull(argv[3], nullptr, 10) << 20;
+    if (argc > 4) tiers.cold_bytes = std::strtoull(argv[4], nullptr, 10) << 20;
+    auto const threads = argc > 5 ? std::max(1, std::atoi(argv[5])) : 8;
+
+    // the budget is split evenly, each slide gets a fixed share of it rather than what its requests need
+    auto const slides = std::max<std::size_t>(1, log->slides.size());
+    auto slide_tiers = tiers;
+    slide_tiers.hot_bytes /= slides;
+    slide_tiers.cold_bytes /= slides;
+    auto scheduler = std::make_shared<TileScheduler>(TileScheduler::Render{});
+    std::vector<std::unique_ptr<DeepZoomGenerator>> generators;
+    std::vector<std::unique_ptr<TileService>> services;
+    for (auto const& slide : log->slides)
+    {
+        auto const path = argc > 6 ? std::string(argv[6]) : slide.path;
+        auto source = open_slide_source(path);
+        if (!source)
+        {
+            std::cerr << "Failed to open slide: " << path << std::endl;
+            return -1;
+        }
+        generators.push_back(
+            std::make_unique<DeepZoomGenerator>(source, slide.tile_size, slide.overlap, slide.limit_bounds));
+        services.push_back(std::make_unique<TileService>(*generators.back(), slide_tiers, scheduler));
+    }
+
+    // the log is in completion order
+    auto& records = log->records;
+    std::stable_sort(records.begin(), records.end(),
+                     [](AccessRecord const& a, AccessRecord const& b) { return a.timestamp_us < b.timestamp_us; });
+
+    std::vector<double> latencies_ms(records.size(), -1.);
+    std::vector<TileOutcome> outcomes(records.size());
+    std::atomic<std::size_t> next{0};
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (auto w = 0; w < threads; w++)
+        workers.emplace_back([&]() {
+            for (auto i = next++; i < records.size(); i = next++)
+            {
+                auto const& r = records[i];
+                if (speed > 0.)
+                    std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(
+                                                              static_cast<double>(r.timestamp_us) / speed)));
+                auto const t0 = std::chrono::steady_clock::now();
+                auto& service = *services[r.slide];
+                auto const col = static_cast<int>(r.index.col), row = static_cast<int>(r.index.row);
+                if (r.deadline_us)
+                    outcomes[i] =
+                        service.get_tile(r.index.level, col, row, t0 + std::chrono::microseconds(*r.deadline_us))
+                            .outcome;
+                else
+                    service.get_tile(r.index.level, col, row, &outcomes[i]);
+                latencies_ms[i] =
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            }
+        });
+    for (auto& worker : workers)
+        worker.join();
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto const recorded_seconds = records.empty() ? 0. : records.back().timestamp_us / 1e6;
+
+    auto const deadlines = std::count_if(records.begin(), records.end(),
+                                         [](AccessRecord const& r) { return r.deadline_us.has_value(); });
+    std::printf("%zu requests (%lld with a deadline) on %zu slides, recorded over %.2fs, replayed in %.2fs at speed "
+                "%g: %.1f tiles/s\n",
+                records.size(), static_cast<long long>(deadlines), log->slides.size(), recorded_seconds, seconds,
+                speed, seconds > 0. ? records.size() / seconds : 0.);
+    std::printf("%-9s %9s %9s %9s %9s %9s  outcomes\n", "latency", "requests", "p50_ms", "p90_ms", "p99_ms", "p999_ms");
+    std::vector<double> recorded_ms;
+    std::vector<uint64_t> recorded_outcomes(5), replayed_outcomes(5);
+    for (std::size_t i = 0; i < records.size(); i++)
+    {
+        recorded_ms.push_back(records[i].latency_us / 1000.);
+        recorded_outcomes[std::min<std::size_t>(4, static_cast<std::size_t>(records[i].outcome))]++;
+        replayed_outcomes[static_cast<std::size_t>(outcomes[i])]++;
+    }
+    _report("recorded", recorded_ms, recorded_outcomes);
+    _report("replayed", latencies_ms, replayed_outcomes);
+    for (std::size_t s = 0; s < services.size(); s++)
+    {
+        auto const& cache = services[s]->cache();
+        std::printf("slide %zu: hot %zu tiles %.1f MiB, cold %zu tiles %.1f MiB (%.1fx)\n", s, cache.hot().size(),
+                    cache.hot().size_bytes() / 1048576., cache.cold().size(), cache.cold().size_bytes() / 1048576.,
+                    cache.compression_ratio());
+    }
+    return 0;
+}
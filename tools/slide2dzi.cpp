@@ -0,0 +1,151 @@
+#include "dzi_writer.hpp"
+#include "shard_export.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <optional>
+
+// export a slide as a Deep Zoom image and report how busy each pipeline stage was
+// with --shard i/N only the i-th of N cost balanced slices is rendered, into a tile pack, and --merge combines the
+// packs of every shard into the final .dzi or pack
+// --resume skips the tiles an interrupted export already wrote, --dry-run only lists how many are missing
+// --dedup stores byte-identical tiles once
+// --native-jpeg exports the aligned geometry and copies the slide's own JPEG tiles where they match a deepzoom tile
+namespace
+{
+    void _print_dedup(DedupStats const& s)
+    {
+        if (s.tiles == 0) return;
+        std::printf("Dedup: %lld of %lld tiles unique, %.1f of %.1f MiB stored (%.2fx)\n",
+                    static_cast<long long>(s.unique_tiles), static_cast<long long>(s.tiles),
+                    s.unique_bytes / 1048576., s.bytes / 1048576., s.ratio());
+    }
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    auto const* program = argv[0];
+    ShardSpec shard;
+    auto sharded = false, resume = false, dry_run = false, dedup = false, native = false;
+    while (argc > 1 && std::strncmp(argv[1], "--", 2) == 0)
+    {
+        if (argc > 3 && std::strcmp(argv[1], "--merge") == 0)
+        {
+            DedupStats stats;
+            if (!merge_shards({argv + 3, argv + argc}, argv[2], dedup, &stats))
+            {
+                std::cerr << "Failed to merge shards into " << argv[2] << std::endl;
+                return -1;
+            }
+            _print_dedup(stats);
+            return 0;
+        }
+        if (argc > 2 && std::strcmp(argv[1], "--shard") == 0)
+        {
+            if (std::sscanf(argv[2], "%d/%d", &shard.index, &shard.count) != 2 || shard.count <= 0 ||
+                shard.index < 0 || shard.index >= shard.count)
+            {
+                std::cerr << "Invalid shard " << argv[2] << ", expected i/N with 0 <= i < N" << std::endl;
+                return -1;
+            }
+            sharded = true;
+            argc--;
+            argv++;
+        }
+        else if (std::strcmp(argv[1], "--resume") == 0)
+            resume = true;
+        else if (std::strcmp(argv[1], "--dry-run") == 0)
+            dry_run = true;
+        else if (std::strcmp(argv[1], "--dedup") == 0)
+            dedup = true;
+        else if (std::strcmp(argv[1], "--native-jpeg") == 0)
+            native = true;
+        else
+            break;
+        argc--;
+        argv++;
+    }
+
+    if (argc < 3 || (sharded && (resume || dry_run)))
+    {
+        std::cerr << "Usage: " << program
+                  << ": [--shard i/N | --resume | --dry-run | --dedup | --native-jpeg] <slide path> "
+                     "<output.dzi | shard.pack> [quality] [read_threads] [convert_threads] [encode_threads] "
+                     "[write_threads]\n"
+                     "       "
+                  << program << ": [--dedup] --merge <output.dzi | output.pack> <shard.pack>..." << std::endl;
+        return -1;
+    }
+
+    auto source = open_slide_source(argv[1]);
+    if (!source)
+    {
+        std::cerr << "Failed to open slide: " << argv[1] << std::endl;
+        return -1;
+    }
+    auto generator = native ? DeepZoomGenerator::aligned(source) : DeepZoomGenerator(source);
+
+    DziOptions options;
+    options.resume = resume;
+    options.dedup = dedup;
+    std::optional<NativeJpegTiles> native_jpeg;
+    if (native) options.native_jpeg = &native_jpeg.emplace(generator, argv[1]);
+    if (argc > 3) options.quality = std::atoi(argv[3]);
+    if (argc > 4) options.stages.read_threads = std::atoi(argv[4]);
+    if (argc > 5) options.stages.convert_threads = std::atoi(argv[5]);
+    if (argc > 6) options.stages.encode_threads = std::atoi(argv[6]);
+    if (argc > 7) options.stages.write_threads = std::atoi(argv[7]);
+
+    if (dry_run)
+    {
+        auto const missing = missing_dzi_tiles(generator, argv[2], options);
+        std::map<int, int64_t> per_level;
+        for (auto const& t : missing)
+            per_level[t.level]++;
+        for (auto const& [level, count] : per_level)
+            std::printf("level %2d: %lld of %lld tiles missing\n", level, static_cast<long long>(count),
+                        static_cast<long long>(generator.level_tiles()[level].first *
+                                               generator.level_tiles()[level].second));
+        std::printf("%lld of %lld tiles missing\n", static_cast<long long>(missing.size()),
+                    static_cast<long long>(generator.tile_count()));
+        return 0;
+    }
+
+    int last_percent = -1;
+    options.progress = [&](int64_t done, int64_t total) {
+        if (auto percent = static_cast<int>(done * 100 / total); percent != last_percent)
+        {
+            last_percent = percent;
+            std::cerr << "\r" << percent << "% (" << done << "/" << total << " tiles)" << std::flush;
+        }
+    };
+
+    ExportStats stats;
+    auto ok = sharded ? write_dzi_shard(generator, argv[2], shard, options, &stats)
+                      : write_dzi(generator, argv[2], options, &stats);
+    std::cerr << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return -1;
+    }
+    std::printf("Wrote %lld tiles in %.2fs (%.1f tiles/s), %lld already present\n", static_cast<long long>(stats.tiles),
+                stats.seconds, stats.seconds > 0. ? stats.tiles / stats.seconds : 0.,
+                static_cast<long long>(stats.skipped));
+    _print_dedup(stats.dedup);
+    if (native_jpeg)
+        std::printf("Native JPEG: %llu of %lld tiles passed through\n",
+                    static_cast<unsigned long long>(native_jpeg->passthrough_count()),
+                    static_cast<long long>(stats.tiles));
+    // the stage closest to 100% utilization is the bottleneck, output waits upstream of it show the backpressure
+    std::printf("%-8s %7s %9s %9s %6s %12s %13s\n", "stage", "threads", "items", "busy_s", "util", "input_waits",
+                "output_waits");
+    for (auto const& s : stats.stages)
+        std::printf("%-8s %7d %9llu %9.2f %5.0f%% %12llu %13llu\n", s.name.c_str(), s.threads,
+                    static_cast<unsigned long long>(s.items), s.busy_seconds, s.utilization * 100.,
+                    static_cast<unsigned long long>(s.input_waits), static_cast<unsigned long long>(s.output_waits));
+    return 0;
+}
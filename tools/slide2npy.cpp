@@ -0,0 +1,59 @@
+#include "npy_writer.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// write one deepzoom level (or a region of it) as a .npy array that numpy and other tools can memory map
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << ": <slide path> <output.npy> [dz_level=-1] [channels=3] [x y width height]" << std::endl
+                  << "negative levels count from the full resolution one, channels 3 is RGB over white, 4 is "
+                     "premultiplied RGBA"
+                  << std::endl;
+        return -1;
+    }
+
+    auto source = open_slide_source(argv[1]);
+    if (!source)
+    {
+        std::cerr << "Failed to open slide: " << argv[1] << std::endl;
+        return -1;
+    }
+    DeepZoomGenerator generator(source);
+
+    auto level = argc > 3 ? std::atoi(argv[3]) : -1;
+    if (level < 0) level += generator.level_count();
+    NpyExportOptions options;
+    if (argc > 4) options.channels = std::atoi(argv[4]);
+    if (argc > 8)
+    {
+        options.x = std::atoll(argv[5]);
+        options.y = std::atoll(argv[6]);
+        options.width = std::atoll(argv[7]);
+        options.height = std::atoll(argv[8]);
+    }
+    int last_percent = -1;
+    options.progress = [&](int64_t done, int64_t total) {
+        if (auto percent = static_cast<int>(done * 100 / total); percent != last_percent)
+        {
+            last_percent = percent;
+            std::cerr << "\r" << percent << "% (" << done << "/" << total << " rows)" << std::flush;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto ok = write_npy(generator, level, argv[2], options);
+    std::cerr << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return -1;
+    }
+    std::cout << "Wrote level " << level << " to " << argv[2] << " in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "tiff_writer.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// convert a slide into a pyramidal BigTIFF that is cheap to serve tiles from
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << ": <slide path> <output.tiff> [tile_size] [quality] [encode_threads]"
+                  << std::endl;
+        return -1;
+    }
+
+    auto source = open_slide_source(argv[1]);
+    if (!source)
+    {
+        std::cerr << "Failed to open slide: " << argv[1] << std::endl;
+        return -1;
+    }
+
+    PyramidTiffOptions options;
+    if (argc > 3) options.tile_size = std::atoi(argv[3]);
+    if (argc > 4) options.quality = std::atoi(argv[4]);
+    if (argc > 5) options.stages.encode_threads = std::atoi(argv[5]);
+    int last_percent = -1;
+    options.progress = [&](int64_t done, int64_t total) {
+        if (auto percent = static_cast<int>(done * 100 / total); percent != last_percent)
+        {
+            last_percent = percent;
+            std::cerr << "\r" << percent << "% (" << done << "/" << total << " tiles)" << std::flush;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto ok = write_pyramidal_tiff(source, argv[2], options);
+    std::cerr << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return -1;
+    }
+    std::cout << "Wrote " << argv[2] << " in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+    return 0;
+}
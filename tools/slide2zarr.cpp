@@ -0,0 +1,51 @@
+#include "zarr_writer.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// convert a slide into an OME-Zarr multiscale image for analysis tools reading arbitrary windows in parallel
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << ": <slide path> <output.zarr> [chunk_size=512] [raw|zlib] [zlib_level=1]"
+                  << std::endl;
+        return -1;
+    }
+
+    auto source = open_slide_source(argv[1]);
+    if (!source)
+    {
+        std::cerr << "Failed to open slide: " << argv[1] << std::endl;
+        return -1;
+    }
+
+    ZarrOptions options;
+    if (argc > 3) options.chunk_size = std::atoi(argv[3]);
+    if (argc > 4 && std::strcmp(argv[4], "raw") == 0) options.compression = ZarrCompression::Raw;
+    if (argc > 5) options.zlib_level = std::atoi(argv[5]);
+    int last_percent = -1;
+    options.progress = [&](int64_t done, int64_t total) {
+        if (auto percent = static_cast<int>(done * 100 / total); percent != last_percent)
+        {
+            last_percent = percent;
+            std::cerr << "\r" << percent << "% (" << done << "/" << total << " chunks)" << std::flush;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto ok = write_zarr(source, argv[2], options);
+    std::cerr << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Failed to write " << argv[2]
+                  << (options.compression == ZarrCompression::Zlib ? " (zlib chunks need a build with zlib)" : "")
+                  << ", an existing non-empty output must be a Zarr store" << std::endl;
+        return -1;
+    }
+    std::cout << "Wrote " << argv[2] << " in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include "zarr_writer.hpp"
+#include "deepzoom.hpp"
+#include "tile_order.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#ifdef DEEPZOOM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Dataset
+    {
+        int dz_level;
+        int64_t width, height;
+        double scale; // level 0 pixels per pixel
+    };
+
+    std::string _json_escape(std::string const& s)
+    {
+        std::string out;
+        for (auto c : s)
+        {
+            if (c == '"' || c == '\\') out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20) out += c;
+        }
+        return out;
+    }
+
+    bool _write_file(fs::path const& path, std::string const& text)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << text;
+        return static_cast<bool>(out);
+    }
+
+    std::string _zarray(Dataset const& d, ZarrOptions const& options)
+    {
+        std::ostringstream s;
+        s << "{\n"
+          << "    \"zarr_format\": 2,\n"
+          << "    \"shape\": [3, " << d.height << ", " << d.width << "],\n"
+          << "    \"chunks\": [3, " << options.chunk_size << ", " << options.chunk_size << "],\n"
+          << "    \"dtype\": \"|u1\",\n"
+          << "    \"compressor\": "
+          << (options.compression == ZarrCompression::Zlib
+                  ? "{\"id\": \"zlib\", \"level\": " + std::to_string(options.zlib_level) + "}"
+                  : std::string("null"))
+          << ",\n"
+          << "    \"fill_value\": 255,\n"
+          << "    \"order\": \"C\",\n"
+          << "    \"filters\": null,\n"
+          << "    \"dimension_separator\": \"/\"\n"
+          << "}\n";
+        return s.str();
+    }
+
+    // https://ngff.openmicroscopy.org/0.4/#multiscale-md, mpp 0 leaves the scales in level 0 pixels
+    // `offset` is the level 0 position of the image's top left corner in the slide (the bounds offset)
+    std::string _zattrs(std::vector<Dataset> const& datasets, std::string const& name, double mpp,
+                        std::pair<int64_t, int64_t> offset)
+    {
+        auto const unit = mpp > 0. ? ", \"unit\": \"micrometer\"" : "";
+        std::ostringstream s;
+        s.precision(12);
+        s << "{\n"
+          << "    \"multiscales\": [\n"
+          << "        {\n"
+          << "            \"version\": \"0.4\",\n"
+          << "            \"name\": \"" << _json_escape(name) << "\",\n"
+          << "            \"axes\": [\n"
+          << "                {\"name\": \"c\", \"type\": \"channel\"},\n"
+          << "                {\"name\": \"y\", \"type\": \"space\"" << unit << "},\n"
+          << "                {\"name\": \"x\", \"type\": \"space\"" << unit << "}\n"
+          << "            ],\n"
+          << "            \"datasets\": [\n";
+        auto const unit_size = mpp > 0. ? mpp : 1.;
+        for (std::size_t i = 0; i < datasets.size(); i++)
+        {
+            auto const scale = datasets[i].scale * unit_size;
+            s << "                {\"path\": \"" << i << "\", \"coordinateTransformations\": [{\"type\": \"scale\", "
+              << "\"scale\": [1.0, " << scale << ", " << scale << "]}, {\"type\": \"translation\", "
+              << "\"translation\": [0.0, " << offset.second * unit_size << ", " << offset.first * unit_size << "]}]}"
+              << (i + 1 < datasets.size() ? "," : "") << "\n";
+        }
+        s << "            ],\n"
+          << "            \"type\": \"area\"\n"
+          << "        }\n"
+          << "    ],\n"
+          << "    \"omero\": {\n"
+          << "        \"rdefs\": {\"model\": \"color\"},\n"
+          << "        \"channels\": [\n";
+        char const* const labels[] = {"R", "G", "B"};
+        char const* const colors[] = {"FF0000", "00FF00", "0000FF"};
+        for (auto c = 0; c < 3; c++)
+            s << "            {\"label\": \"" << labels[c] << "\", \"color\": \"" << colors[c]
+              << "\", \"active\": true, \"window\": {\"min\": 0, \"max\": 255, \"start\": 0, \"end\": 255}}"
+              << (c < 2 ? "," : "") << "\n";
+        s << "        ]\n"
+          << "    }\n"
+          << "}\n";
+        return s.str();
+    }
+
+    // premultiplied b, g, r, a tile into planar r, g, b of a full chunk, composited over white, the padding white
+    std::vector<uint8_t> _chunk(std::vector<uint8_t> const& bgra, int width, int height, int chunk_size)
+    {
+        auto const plane = static_cast<std::size_t>(chunk_size) * chunk_size;
+        std::vector<uint8_t> chunk(plane * 3, 255);
+        for (auto y = 0; y < height; y++)
+        {
+            auto const* p = bgra.data() + static_cast<std::size_t>(y) * width * 4;
+            auto const row = static_cast<std::size_t>(y) * chunk_size;
+            for (auto x = 0; x < width; x++, p += 4)
+            {
+                auto const white = 255 - p[3];
+                chunk[row + x] = static_cast<uint8_t>(std::min(255, p[2] + white));
+                chunk[plane + row + x] = static_cast<uint8_t>(std::min(255, p[1] + white));
+                chunk[2 * plane + row + x] = static_cast<uint8_t>(std::min(255, p[0] + white));
+            }
+        }
+        return chunk;
+    }
+} // namespace
+
+bool write_zarr(std::shared_ptr<SlideSource> source, std::string const& path, ZarrOptions const& options,
+                ExportStats* stats)
+{
+    auto const cs = options.chunk_size;
+    if (!source || cs <= 0) return false;
+#ifndef DEEPZOOM_HAVE_ZLIB
+    if (options.compression == ZarrCompression::Zlib) return false;
+#endif
+
+    DeepZoomGenerator generator(source, cs, 0, options.limit_bounds);
+    auto const dimensions = generator.level_dimensions();
+    auto const tiles = generator.level_tiles();
+    auto const top = generator.level_count() - 1;
+
+    // full resolution first, stop at the first level that fits into one chunk
+    std::vector<Dataset> datasets;
+    int64_t total = 0;
+    for (auto l = top; l >= 0; l--)
+    {
+        auto const scale = static_cast<double>(int64_t{1} << (top - l));
+        datasets.push_back({l, dimensions[l].first, dimensions[l].second, scale});
+        total += tiles[l].first * tiles[l].second;
+        if (tiles[l].first == 1 && tiles[l].second == 1) break;
+    }
+
+    auto const root = fs::path(path);
+    std::error_code ec;
+    if (!fs::is_empty(root, ec) && !ec)
+    {
+        // only ever clean up an earlier store, never some other directory the path happens to name
+        if (!fs::exists(root / ".zgroup", ec)) return false;
+        // multiscales from an earlier run would describe a store that is not complete yet
+        fs::remove(root / ".zattrs", ec);
+        // so are its arrays, chunks of another chunk size or slide would outlive this run where its chunks do not
+        // overlap
+        std::vector<fs::path> stale;
+        for (auto const& entry : fs::directory_iterator(root, ec))
+            if (entry.is_directory(ec) && fs::exists(entry.path() / ".zarray", ec)) stale.push_back(entry.path());
+        for (auto const& dir : stale)
+            if (fs::remove_all(dir, ec); ec) return false;
+    }
+    if (fs::create_directories(root, ec); ec) return false;
+    if (!_write_file(root / ".zgroup", "{\n    \"zarr_format\": 2\n}\n")) return false;
+    for (std::size_t i = 0; i < datasets.size(); i++)
+    {
+        auto const dir = root / std::to_string(i);
+        // chunk keys are <channel chunk>/<row>/<col>, there is one channel chunk
+        for (int64_t row = 0; row < tiles[datasets[i].dz_level].second; row++)
+            if (fs::create_directories(dir / "0" / std::to_string(row), ec); ec) return false;
+        if (!_write_file(dir / ".zarray", _zarray(datasets[i], options))) return false;
+    }
+
+    std::mutex progress_mutex;
+    int64_t written = 0;
+    auto stages = options.stages;
+    if (stages.write_threads <= 0) stages.write_threads = 4;
+
+    auto ok = run_export_pipeline(
+        generator, TileRange(tiles, TileOrder::Hilbert, datasets.back().dz_level, top), stages,
+        [&](ExportTile& t) {
+            t.encoded = _chunk(t.pixels, t.width, t.height, cs);
+#ifdef DEEPZOOM_HAVE_ZLIB
+            if (options.compression == ZarrCompression::Zlib)
+            {
+                auto bound = compressBound(static_cast<uLong>(t.encoded.size()));
+                std::vector<uint8_t> compressed(bound);
+                if (compress2(compressed.data(), &bound, t.encoded.data(), static_cast<uLong>(t.encoded.size()),
+                              options.zlib_level) != Z_OK)
+                    bound = 0; // an empty chunk fails the write stage
+                compressed.resize(bound);
+                t.encoded.swap(compressed);
+            }
+#endif
+        },
+        [&](ExportTile const& t) {
+            if (t.encoded.empty()) return false;
+            auto const dataset = top - t.index.level;
+            auto const chunk = root / std::to_string(dataset) / "0" / std::to_string(t.index.row) /
+                               std::to_string(t.index.col);
+            std::ofstream out(chunk, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<char const*>(t.encoded.data()), t.encoded.size());
+            if (!out) return false;
+            if (options.progress)
+            {
+                std::lock_guard<std::mutex> lock(progress_mutex);
+                options.progress(++written, total);
+            }
+            return true;
+        },
+        stats);
+    if (!ok) return false;
+
+    auto const name = root.filename().empty() ? root.parent_path().stem().string() : root.stem().string();
+    return _write_file(root / ".zattrs", _zattrs(datasets, name, generator.mpp(), generator.l0_offset()));
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "export_pipeline.hpp"
+#include "slide_source.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+enum class ZarrCompression
+{
+    Raw,
+    Zlib // needs zlib at build time (DEEPZOOM_HAVE_ZLIB)
+};
+
+struct ZarrOptions
+{
+    int chunk_size = 512; // chunk width and height in pixels
+    ZarrCompression compression = ZarrCompression::Zlib;
+    int zlib_level = 1;
+    bool limit_bounds = false; // convert only the non-empty slide region
+    ExportStages stages;       // chunks are written by 4 threads unless set otherwise
+    // called after every written chunk with <chunks written, total chunks>
+    std::function<void(int64_t, int64_t)> progress;
+};
+
+// convert a slide into an OME-Zarr (NGFF 0.4) multiscale image in a Zarr v2 directory store
+// the arrays "0", "1", ... are the deepzoom levels from full resolution down to the first one that fits into a single
+// chunk, uint8 with axes (c, y, x) holding r, g, b composited over white, chunked (3, chunk_size, chunk_size) with
+// "/" separated chunk keys; the scales are in micrometers when the slide has an mpp
+// every chunk is one tile of a generator with the chunk size as tile size and no overlap, rendered through the
+// export pipeline and written in parallel; .zattrs is written last, so an interrupted store has no multiscales
+// an existing store at `path` is overwritten, its arrays removed first; any other non-empty directory is refused
+// returns false on I/O error, invalid options, Zlib without zlib or a non-empty `path` that is not a Zarr store
+bool write_zarr(std::shared_ptr<SlideSource> source, std::string const& path, ZarrOptions const& options = {},
+                ExportStats* stats = nullptr);